@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Expansion.h"
+#include "Graph.h"
+#include "Position.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+// Moves of the grid and the distance estimate that fits them, for all CPU engines: SearchCore
+// expands through EightConnected or FourConnected, the engines with loops of their own walk the
+// moves of GraphMoves.
+
+// Float costs of a graph that is not quantized, read in place
+struct FloatCosts {
+    explicit FloatCosts(const Graph &graph)
+        : data(static_cast<const float *>(graph.costData())) {}
+
+    float operator[](int node) const { return data[node]; }
+
+    const float *data;
+};
+
+// Levels of a quantized graph, turned into costs like Graph::cost() on every read instead of
+// copied into floats up front
+template <typename Level>
+struct QuantizedCosts {
+    explicit QuantizedCosts(const Graph &graph)
+        : data(static_cast<const Level *>(graph.costData())), scale(graph.costScale()) {}
+
+    float operator[](int node) const {
+        return data[node] != std::numeric_limits<Level>::max()
+                   ? data[node] * scale
+                   : std::numeric_limits<float>::infinity();
+    }
+
+    const Level *data;
+    float        scale;
+};
+
+// The eight moves of GRAPH_DIAGONAL_MOVEMENT, numbered like Expansion and move_direction() in
+// gpuAStar.cl.
+struct EightMoves {
+    static constexpr int moveCount = 8;
+
+    static int  moveX(int move) { return Expansion::dx[move]; }
+    static int  moveY(int move) { return Expansion::dy[move]; }
+    static bool diagonal(int move) { return moveX(move) != 0 && moveY(move) != 0; }
+
+    // Octile distance, same as in the expansion and the kernels. In 64 bit, so far apart positions
+    // of tiled graphs do not overflow.
+    static float distance(const Position &from, const Position &to) {
+        const auto distX = std::abs((std::int64_t) to.x - from.x);
+        const auto distY = std::abs((std::int64_t) to.y - from.y);
+        return (distX + distY) + (1.41421356237f - 2) * std::min(distX, distY);
+    }
+};
+
+// The same moves, expanded all at once by one of the functions of Expansion.h. Called directly,
+// not through expandFunction().
+template <ExpandFunction expandCell>
+struct EightConnected : EightMoves {
+    // Calls visit(node, totalCost, estimate) for the passable neighbors of node, with the
+    // estimate of the distance to target.
+    template <typename Visit>
+    static void expand(const FloatCosts &costs, int width, int height, int node, float totalCost,
+                       const Position &target, Visit &&visit) {
+        Expansion expansion;
+        expandCell(costs.data, width, height, node % width, node / width, totalCost, target.x,
+                   target.y, expansion);
+
+        for (int i = 0; i < moveCount; ++i) {
+            // Outside of the grid or blocked
+            if (expansion.totalCosts[i] == std::numeric_limits<float>::infinity())
+                continue;
+
+            visit(node + moveY(i) * width + moveX(i), expansion.totalCosts[i],
+                  expansion.heuristics[i]);
+        }
+    }
+
+    // Quantized costs: the same as expandScalar(), reading through the costs
+    template <typename Costs, typename Visit>
+    static void expand(const Costs &costs, int width, int height, int node, float totalCost,
+                       const Position &target, Visit &&visit) {
+        const int   x = node % width, y = node / width;
+        const float cost = costs[node];
+        for (int i = 0; i < moveCount; ++i) {
+            const int nbX = x + moveX(i), nbY = y + moveY(i);
+            if (nbX < 0 || nbY < 0 || nbX >= width || nbY >= height)
+                continue;
+
+            const int   nbNode = nbY * width + nbX;
+            const float nbTotalCost =
+                totalCost + std::max(cost, costs[nbNode]) * (diagonal(i) ? 1.41421356237f : 1.0f);
+            if (nbTotalCost == std::numeric_limits<float>::infinity())
+                continue;
+
+            visit(nbNode, nbTotalCost, distance({nbX, nbY}, target));
+        }
+    }
+};
+
+// The four moves without GRAPH_DIAGONAL_MOVEMENT, clockwise from the top like Node::neighbors().
+struct FourConnected {
+    static constexpr int moveCount = 4;
+
+    static int moveX(int move) {
+        static const int dx[4] = {0, 1, 0, -1};
+        return dx[move];
+    }
+    static int moveY(int move) {
+        static const int dy[4] = {-1, 0, 1, 0};
+        return dy[move];
+    }
+    static bool diagonal(int) { return false; }
+
+    // Manhattan distance, exact for four moves. The kernels always use the octile distance. In 64
+    // bit like EightMoves::distance().
+    static float distance(const Position &from, const Position &to) {
+        return (float) (std::abs((std::int64_t) to.x - from.x) +
+                        std::abs((std::int64_t) to.y - from.y));
+    }
+
+    template <typename Costs, typename Visit>
+    static void expand(const Costs &costs, int width, int height, int node, float totalCost,
+                       const Position &target, Visit &&visit) {
+        const int   x = node % width, y = node / width;
+        const float cost = costs[node];
+        for (int i = 0; i < moveCount; ++i) {
+            const int nbX = x + moveX(i), nbY = y + moveY(i);
+            if (nbX < 0 || nbY < 0 || nbX >= width || nbY >= height)
+                continue;
+
+            // Same as Graph::pathCost(), infinite for blocked cells
+            const int   nbNode = nbY * width + nbX;
+            const float nbTotalCost = totalCost + std::max(cost, costs[nbNode]);
+            if (nbTotalCost == std::numeric_limits<float>::infinity())
+                continue;
+
+            visit(nbNode, nbTotalCost, distance({nbX, nbY}, target));
+        }
+    }
+};
+
+// The moves of Graph, see GRAPH_DIAGONAL_MOVEMENT
+#ifdef GRAPH_DIAGONAL_MOVEMENT
+using GraphMoves = EightMoves;
+#else
+using GraphMoves = FourConnected;
+#endif
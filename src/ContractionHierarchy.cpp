@@ -0,0 +1,417 @@
+#include "ContractionHierarchy.h"
+
+#include "PriorityQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <thread>
+
+namespace {
+const float inf = std::numeric_limits<float>::infinity();
+
+// Witness searches give up after this many nodes and add the shortcut, which is always correct.
+// Fewer suffice to estimate the shortcuts for the contraction order.
+const int maxSettled = 500;
+const int maxSettledEstimate = 50;
+
+// Edge of the graph while contracting, stored at both ends
+struct Edge {
+    int   node;
+    float cost;
+    int   middle; // as in ContractionHierarchy::Arc
+};
+
+struct Shortcut {
+    int   from, to;
+    float cost;
+    int   middle;
+};
+
+struct OpenEntry {
+    OpenEntry(int _node, float _totalCost) : node(_node), totalCost(_totalCost) {}
+
+    int   node;
+    float totalCost; // g-value when queued, entries with outdated values are skipped
+};
+
+// Comparator to put cheapest nodes first. The searches are short, so a binary heap beats the
+// radix heap of cpuAStar here.
+struct Compare {
+    bool operator()(const OpenEntry &a, const OpenEntry &b) { return a.totalCost > b.totalCost; }
+};
+
+// Bounded Dijkstra over the nodes not contracted yet, one per thread
+class WitnessSearch {
+public:
+    explicit WitnessSearch(std::size_t size) : m_costs(size, inf), m_targets(size, 0) {}
+
+    // Shortcuts needed to contract node: a pair of its neighbors needs one if no path avoiding
+    // node is as short as the one over it. Paths equal up to rounding count as just as short.
+    void shortcuts(const std::vector<std::vector<Edge>> &edges,
+                   const std::vector<char> &contracted, int node, int settleLimit,
+                   std::vector<Shortcut> &result) {
+        const auto &neighbors = edges[node];
+        for (std::size_t i = 0; i + 1 < neighbors.size(); ++i) {
+            float limit = 0.0f;
+            for (std::size_t j = i + 1; j < neighbors.size(); ++j) {
+                limit = std::max(limit, neighbors[i].cost + neighbors[j].cost);
+                m_targets[neighbors[j].node] = 1;
+            }
+
+            search(edges, contracted, neighbors[i].node, node, limit, settleLimit,
+                   (int) (neighbors.size() - i - 1));
+            for (std::size_t j = i + 1; j < neighbors.size(); ++j) {
+                const float cost = neighbors[i].cost + neighbors[j].cost;
+                if (m_costs[neighbors[j].node] > cost * (1.0f + 1e-6f))
+                    result.push_back({neighbors[i].node, neighbors[j].node, cost, node});
+                m_targets[neighbors[j].node] = 0;
+            }
+            reset();
+        }
+    }
+
+private:
+    void search(const std::vector<std::vector<Edge>> &edges, const std::vector<char> &contracted,
+                int source, int skip, float limit, int settleLimit, int targets) {
+        m_costs[source] = 0.0f;
+        m_touched.push_back(source);
+        m_open.emplace(source, 0.0f);
+
+        for (int settled = 0; !m_open.empty() && settled < settleLimit && targets > 0;) {
+            const auto current = m_open.top();
+            m_open.pop();
+            if (current.totalCost != m_costs[current.node])
+                continue;
+            if (current.totalCost > limit)
+                break;
+
+            ++settled;
+            if (m_targets[current.node])
+                --targets;
+
+            for (const auto &edge : edges[current.node]) {
+                if (edge.node == skip || contracted[edge.node])
+                    continue;
+
+                const float totalCost = current.totalCost + edge.cost;
+                if (totalCost >= m_costs[edge.node])
+                    continue;
+
+                if (m_costs[edge.node] == inf)
+                    m_touched.push_back(edge.node);
+                m_costs[edge.node] = totalCost;
+                m_open.emplace(edge.node, totalCost);
+            }
+        }
+    }
+
+    void reset() {
+        for (const auto node : m_touched)
+            m_costs[node] = inf;
+        m_touched.clear();
+        m_open.clear();
+    }
+
+    std::vector<float>             m_costs;
+    std::vector<char>              m_targets; // neighbors of the contracted node, besides source
+    std::vector<int>               m_touched;
+    PriorityQueue<OpenEntry, Compare> m_open;
+};
+
+// Run work(search, i) for all i < count on all threads, each with its own witness search
+void parallelFor(std::vector<WitnessSearch> &searches, std::size_t count,
+                 const std::function<void(WitnessSearch &, std::size_t)> &work) {
+    std::atomic<std::size_t> next{0};
+    auto                     run = [&](WitnessSearch &search) {
+        for (auto i = next++; i < count; i = next++)
+            work(search, i);
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 1; i < std::min(searches.size(), count); ++i)
+        pool.emplace_back(run, std::ref(searches[i]));
+    run(searches[0]);
+    for (auto &thread : pool)
+        thread.join();
+}
+
+// Insert the edge, or lower the cost of an existing one
+bool addEdge(std::vector<Edge> &edges, int node, float cost, int middle) {
+    for (auto &edge : edges) {
+        if (edge.node != node)
+            continue;
+        if (cost < edge.cost)
+            edge = {node, cost, middle};
+        return false;
+    }
+    edges.push_back({node, cost, middle});
+    return true;
+}
+
+// Search state of a query, left clean for the next one of the same thread
+struct QueryState {
+    void resize(std::size_t size) {
+        if (costs[0].size() >= size)
+            return;
+        for (int direction = 0; direction < 2; ++direction) {
+            costs[direction].assign(size, inf);
+            predecessors[direction].assign(size, -1);
+        }
+    }
+
+    void reset() {
+        for (int direction = 0; direction < 2; ++direction) {
+            for (const auto node : touched[direction]) {
+                costs[direction][node] = inf;
+                predecessors[direction][node] = -1;
+            }
+            touched[direction].clear();
+            open[direction].clear();
+        }
+    }
+
+    std::vector<float>                costs[2]; // from the source, from the destination
+    std::vector<int>                  predecessors[2];
+    std::vector<int>                  touched[2];
+    PriorityQueue<OpenEntry, Compare> open[2];
+};
+} // namespace
+
+ContractionHierarchy::ContractionHierarchy(const Graph &graph, unsigned threads)
+    : m_graph(graph), m_rank(graph.size(), -1) {
+    const int size = graph.size();
+
+    // The grid graph as in gpuAStar, with step costs
+    std::vector<std::vector<Edge>> edges(size);
+    for (int y = 0; y < graph.height(); ++y) {
+        for (int x = 0; x < graph.width(); ++x) {
+            for (const auto &neighbor : Node(graph, x, y).neighbors()) {
+                const auto &nbPosition = neighbor.first.position();
+                edges[y * graph.width() + x].push_back(
+                    {nbPosition.y * graph.width() + nbPosition.x, neighbor.second, -1});
+            }
+        }
+    }
+
+    const unsigned workerCount =
+        threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<WitnessSearch> searches(workerCount, WitnessSearch(size));
+
+    std::vector<char>  contracted(size, 0);
+    std::vector<int>   deletedNeighbors(size, 0); // spread the contraction over the map
+    std::vector<float> priorities(size);
+    std::vector<int>   levels(size, 0); // longest chain of contracted nodes below
+
+    // Edge difference of contracting node, plus terms that keep the hierarchy flat
+    auto updatePriority = [&](WitnessSearch &search, int node) {
+        std::vector<Shortcut> shortcuts;
+        search.shortcuts(edges, contracted, node, maxSettledEstimate, shortcuts);
+        priorities[node] = 2.0f * ((float) shortcuts.size() - (float) edges[node].size()) +
+                           (float) deletedNeighbors[node] + (float) levels[node];
+    };
+
+    std::vector<int> remaining(size);
+    for (int node = 0; node < size; ++node)
+        remaining[node] = node;
+    parallelFor(searches, remaining.size(), [&](WitnessSearch &search, std::size_t i) {
+        updatePriority(search, remaining[i]);
+    });
+
+    // Ties are broken by a hash of the index, so that a row of equal nodes does not contract one
+    // node per round.
+    auto lessImportant = [&](int a, int b) {
+        const auto hashA = (std::uint32_t) a * 2654435761u, hashB = (std::uint32_t) b * 2654435761u;
+        return priorities[a] < priorities[b] || (priorities[a] == priorities[b] && hashA < hashB);
+    };
+
+    std::vector<std::vector<Edge>> upward(size);
+    std::vector<int>               updated(size, -1); // last round in which a priority changed
+    int                            rank = 0;
+    for (int round = 0; !remaining.empty(); ++round) {
+        // Nodes less important than all their neighbors, never adjacent to each other. The witness
+        // searches of the round avoid all of them.
+        std::vector<int> selected, rest;
+        for (const auto node : remaining) {
+            const bool minimum =
+                std::all_of(edges[node].begin(), edges[node].end(),
+                            [&](const Edge &edge) { return lessImportant(node, edge.node); });
+            (minimum ? selected : rest).push_back(node);
+        }
+        for (const auto node : selected)
+            contracted[node] = 1;
+
+        std::vector<std::vector<Shortcut>> shortcuts(selected.size());
+        parallelFor(searches, selected.size(), [&](WitnessSearch &search, std::size_t i) {
+            search.shortcuts(edges, contracted, selected[i], maxSettled, shortcuts[i]);
+        });
+
+        // Neighbors are more important by now, the remaining edges become arcs upwards.
+        std::vector<int> neighbors;
+        for (std::size_t i = 0; i < selected.size(); ++i) {
+            const int node = selected[i];
+            m_rank[node] = rank++;
+
+            for (const auto &edge : edges[node]) {
+                auto &nbEdges = edges[edge.node];
+                nbEdges.erase(std::find_if(nbEdges.begin(), nbEdges.end(), [&](const Edge &nbEdge) {
+                    return nbEdge.node == node;
+                }));
+                ++deletedNeighbors[edge.node];
+                levels[edge.node] = std::max(levels[edge.node], levels[node] + 1);
+                if (updated[edge.node] != round) {
+                    updated[edge.node] = round;
+                    neighbors.push_back(edge.node);
+                }
+            }
+            upward[node] = std::move(edges[node]);
+            edges[node].clear();
+
+            for (const auto &shortcut : shortcuts[i]) {
+                if (addEdge(edges[shortcut.from], shortcut.to, shortcut.cost, shortcut.middle))
+                    ++m_shortcuts;
+                addEdge(edges[shortcut.to], shortcut.from, shortcut.cost, shortcut.middle);
+            }
+        }
+
+        parallelFor(searches, neighbors.size(), [&](WitnessSearch &search, std::size_t i) {
+            updatePriority(search, neighbors[i]);
+        });
+        remaining = std::move(rest);
+    }
+
+    m_offsets.reserve(size + 1);
+    m_offsets.push_back(0);
+    for (const auto &arcs : upward) {
+        for (const auto &edge : arcs)
+            m_arcs.push_back({edge.node, edge.cost, edge.middle});
+        m_offsets.push_back((std::uint32_t) m_arcs.size());
+    }
+}
+
+std::vector<Node> ContractionHierarchy::path(const Position &source, const Position &destination,
+                                             CpuSearchStats *stats) const {
+    if (stats)
+        stats->beginSearch();
+
+    const int width = m_graph.width();
+    const int ends[2] = {source.y * width + source.x, destination.y * width + destination.x};
+
+    thread_local QueryState state;
+    state.resize(m_graph.size());
+
+    auto &open = state.open;
+    for (int direction = 0; direction < 2; ++direction) {
+        state.costs[direction][ends[direction]] = 0.0f;
+        state.touched[direction].push_back(ends[direction]);
+        open[direction].emplace(ends[direction], 0.0f);
+    }
+
+    // Search upwards from both ends, alternating by the lower cost, until neither can improve
+    // the best path over a node reached from both.
+    float best = inf;
+    int   meeting = -1;
+    while (!open[0].empty() || !open[1].empty()) {
+        const float lowest[2] = {open[0].empty() ? inf : open[0].top().totalCost,
+                                 open[1].empty() ? inf : open[1].top().totalCost};
+        const int   direction = lowest[0] <= lowest[1] ? 0 : 1;
+        if (lowest[direction] >= best)
+            break;
+
+        const auto current = open[direction].top();
+        open[direction].pop();
+        auto &costs = state.costs[direction];
+        if (current.totalCost != costs[current.node])
+            continue;
+
+        if (stats)
+            stats->expanded(current.node);
+
+        const float totalCost = current.totalCost + state.costs[1 - direction][current.node];
+        if (totalCost < best) {
+            best = totalCost;
+            meeting = current.node;
+        }
+
+        // Stall-on-demand: a more important node reached already may lead here cheaper, over an
+        // arc down. Then no shortest path continues upwards from here.
+        const auto begin = m_offsets[current.node], end = m_offsets[current.node + 1];
+        if (std::any_of(m_arcs.begin() + begin, m_arcs.begin() + end, [&](const Arc &arc) {
+                return costs[arc.node] + arc.cost < current.totalCost;
+            }))
+            continue;
+
+        for (auto arc = m_offsets[current.node]; arc < m_offsets[current.node + 1]; ++arc) {
+            const auto &next = m_arcs[arc];
+            const float nextCost = current.totalCost + next.cost;
+            if (stats)
+                stats->relaxed();
+            if (nextCost >= costs[next.node])
+                continue;
+
+            if (costs[next.node] == inf)
+                state.touched[direction].push_back(next.node);
+            costs[next.node] = nextCost;
+            state.predecessors[direction][next.node] = current.node;
+            open[direction].emplace(next.node, nextCost);
+        }
+        if (stats)
+            stats->openSize(open[0].size() + open[1].size());
+    }
+
+    std::vector<Node> path;
+    if (meeting >= 0) {
+        if (stats)
+            stats->foundPath();
+
+        // Nodes of the hierarchy from source to destination, then the skipped cells in between
+        std::vector<int> nodes;
+        for (int node = meeting; node >= 0; node = state.predecessors[0][node])
+            nodes.push_back(node);
+        std::reverse(nodes.begin(), nodes.end());
+        for (int node = state.predecessors[1][meeting]; node >= 0;
+             node = state.predecessors[1][node])
+            nodes.push_back(node);
+
+        path.emplace_back(m_graph, source);
+        for (std::size_t i = 1; i < nodes.size(); ++i)
+            unpack(nodes[i - 1], nodes[i], path);
+    }
+
+    state.reset();
+    if (stats)
+        stats->endSearch();
+    return path;
+}
+
+PathSet ContractionHierarchy::paths(const std::vector<std::pair<Position, Position>> &srcDstList,
+                                    CpuSearchStats *stats) const {
+    PathSet paths(m_graph.width());
+    paths.reserve(srcDstList.size(), 0);
+    for (const auto &srcDst : srcDstList)
+        paths.push_back(path(srcDst.first, srcDst.second, stats));
+    return paths;
+}
+
+// The node skipped by the arc between a and b, stored at the less important one
+int ContractionHierarchy::middle(int a, int b) const {
+    const int lower = m_rank[a] < m_rank[b] ? a : b, upper = a + b - lower;
+    for (auto arc = m_offsets[lower]; arc < m_offsets[lower + 1]; ++arc)
+        if (m_arcs[arc].node == upper)
+            return m_arcs[arc].middle;
+
+    assert(false && "no arc between the nodes");
+    return -1;
+}
+
+// Append the cells after from up to to
+void ContractionHierarchy::unpack(int from, int to, std::vector<Node> &path) const {
+    const int skipped = middle(from, to);
+    if (skipped < 0) {
+        path.emplace_back(m_graph, to % m_graph.width(), to / m_graph.width());
+        return;
+    }
+    unpack(from, skipped, path);
+    unpack(skipped, to, path);
+}
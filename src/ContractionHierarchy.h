@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Graph.h"
+#include "Node.h"
+#include "PathSet.h"
+#include "Position.h"
+#include "SearchStats.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Contraction hierarchy for static maps, see Geisberger et al., "Contraction Hierarchies: Faster
+// and Simpler Hierarchical Routing in Road Networks". Nodes are contracted in order of importance:
+// a contracted node is removed from the grid graph, and shortcuts between its neighbors keep the
+// distances of the remaining nodes. Nodes are ordered in rounds, each contracting an independent
+// set of nodes in parallel, see Vetter, "Parallel Time-Dependent Contraction Hierarchies".
+// Queries search only towards more important nodes, from both ends. The graph must outlive the
+// hierarchy and must not change.
+class ContractionHierarchy {
+public:
+    // Order and contract all nodes, threads = 0 uses one per hardware thread.
+    explicit ContractionHierarchy(const Graph &graph, unsigned threads = 0);
+
+    // Optimal path like cpuAStar, with the shortcuts unpacked to grid cells. Empty if there is
+    // none. Thread-safe.
+    std::vector<Node> path(const Position &source, const Position &destination,
+                           CpuSearchStats *stats = nullptr) const;
+
+    // Batch version of the above, same result type as gpuAStar.
+    PathSet paths(const std::vector<std::pair<Position, Position>> &srcDstList,
+                  CpuSearchStats *                                  stats = nullptr) const;
+
+    std::size_t arcs() const { return m_arcs.size(); }
+    std::size_t shortcuts() const { return m_shortcuts; }
+
+private:
+    // Arc to a more important node
+    struct Arc {
+        int   node;
+        float cost;
+        int   middle; // contracted node the shortcut skips, -1 for edges of the grid
+    };
+
+    int  middle(int a, int b) const;
+    void unpack(int from, int to, std::vector<Node> &path) const;
+
+    const Graph &              m_graph;
+    std::vector<int>           m_rank;    // contraction order
+    std::vector<std::uint32_t> m_offsets; // arcs of node i are [m_offsets[i], m_offsets[i + 1])
+    std::vector<Arc>           m_arcs;
+    std::size_t                m_shortcuts = 0;
+};
@@ -0,0 +1,201 @@
+#include "DStarLite.h"
+
+#include "Connectivity.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace {
+const float inf = std::numeric_limits<float>::infinity();
+
+// Relative difference below which keys count as equal, for rounding errors in sums of costs
+const float keyTolerance = 1e-5f;
+
+// Calls f with the index of every neighbor of node inside the graph
+template <typename Function>
+void forEachNeighbor(const Graph &graph, int node, Function f) {
+    const int x = node % graph.width(), y = node / graph.width();
+    for (int move = 0; move < GraphMoves::moveCount; ++move) {
+        const int nbX = x + GraphMoves::moveX(move), nbY = y + GraphMoves::moveY(move);
+        if (nbX >= 0 && nbY >= 0 && nbX < graph.width() && nbY < graph.height())
+            f(nbY * graph.width() + nbX);
+    }
+}
+} // namespace
+
+DStarLite::DStarLite(const Graph &graph, const Position &start, const Position &goal)
+    : m_graph(graph), m_start(start), m_goal(goal), m_g(graph.size(), inf),
+      m_rhs(graph.size(), inf), m_openKey(graph.size()), m_open(graph.size(), 0) {
+    const int goalIndex = goal.y * graph.width() + goal.x;
+    m_rhs[goalIndex] = 0.0f;
+    updateNode(goalIndex);
+}
+
+float DStarLite::heuristic(int node) const {
+    return GraphMoves::distance(m_start, {node % m_graph.width(), node / m_graph.width()});
+}
+
+float DStarLite::stepCost(int from, int to) const {
+    const int width = m_graph.width();
+    return m_graph.pathCost({m_graph, from % width, from / width},
+                            {m_graph, to % width, to / width});
+}
+
+DStarLite::Key DStarLite::calculateKey(int node) const {
+    const float g = std::min(m_g[node], m_rhs[node]);
+    return {g + heuristic(node) + m_keyModifier, g};
+}
+
+float DStarLite::bestSuccessor(int node) const {
+    float best = inf;
+    forEachNeighbor(m_graph, node,
+                    [&](int nb) { best = std::min(best, stepCost(node, nb) + m_g[nb]); });
+    return best;
+}
+
+// Queue the node if it is inconsistent, otherwise drop it from the queue.
+void DStarLite::updateNode(int node) {
+    if (m_g[node] != m_rhs[node]) {
+        m_openKey[node] = calculateKey(node);
+        m_open[node] = 1;
+        m_queue.emplace(m_openKey[node], node);
+    } else {
+        m_open[node] = 0;
+    }
+}
+
+DStarLite::Key DStarLite::topKey() {
+    while (!m_queue.empty()) {
+        const auto &top = m_queue.top();
+        if (m_open[top.node] && m_openKey[top.node] == top.key)
+            return top.key;
+        m_queue.pop();
+    }
+    return {inf, inf};
+}
+
+template <typename Stats>
+void DStarLite::computeShortestPath(Stats &stats) {
+    const int width = m_graph.width();
+    const int start = m_start.y * width + m_start.x;
+    const int goal = m_goal.y * width + m_goal.x;
+
+    // Unlike in the paper, nodes with about the same key as the start are expanded as well.
+    // Otherwise g-values of nodes tying with it may be outdated, and the path is read from them.
+    auto pending = [&]() {
+        const float topKey = this->topKey().first; // infinite only for an empty queue
+        const float startKey = calculateKey(start).first;
+        return topKey != inf &&
+               (topKey <= startKey + keyTolerance * startKey || m_rhs[start] != m_g[start]);
+    };
+
+    while (pending()) {
+        stats.openSize(m_queue.size());
+        const auto node = m_queue.top().node;
+        const auto oldKey = m_queue.top().key;
+        const auto newKey = calculateKey(node);
+        m_queue.pop();
+        m_open[node] = 0;
+
+        // Key based on an older position of the agent: requeue with the current one
+        if (oldKey < newKey) {
+            updateNode(node);
+            continue;
+        }
+
+        stats.expanded(node);
+        if (m_g[node] > m_rhs[node]) {
+            // Overconsistent: the node got cheaper, so may its predecessors
+            m_g[node] = m_rhs[node];
+            forEachNeighbor(m_graph, node, [&](int nb) {
+                if (nb != goal && stepCost(nb, node) + m_g[node] < m_rhs[nb]) {
+                    m_rhs[nb] = stepCost(nb, node) + m_g[node];
+                    stats.relaxed();
+                    updateNode(nb);
+                }
+            });
+        } else {
+            // Underconsistent: the node got more expensive, recompute everything depending on it
+            const float oldG = m_g[node];
+            m_g[node] = inf;
+            auto update = [&](int other) {
+                if (other != goal && m_rhs[other] == stepCost(other, node) + oldG) {
+                    m_rhs[other] = bestSuccessor(other);
+                    stats.relaxed();
+                }
+                updateNode(other);
+            };
+            forEachNeighbor(m_graph, node, update);
+            if (node != goal)
+                m_rhs[node] = bestSuccessor(node);
+            updateNode(node);
+        }
+    }
+}
+
+std::vector<Node> DStarLite::path(CpuSearchStats *stats) {
+    if (m_start == m_goal)
+        return {{m_graph, m_goal}};
+
+    if (stats) {
+        stats->beginSearch();
+        computeShortestPath(*stats);
+    } else {
+        NoSearchStats noStats;
+        computeShortestPath(noStats);
+    }
+
+    const int width = m_graph.width();
+    int       node = m_start.y * width + m_start.x;
+    const int goal = m_goal.y * width + m_goal.x;
+
+    std::vector<Node> result;
+    if (m_rhs[node] != inf) {
+        if (stats)
+            stats->foundPath();
+
+        // Follow the cheapest successors down to the goal
+        result.emplace_back(m_graph, m_start);
+        while (node != goal && result.size() <= (std::size_t) m_graph.size()) {
+            int   next = -1;
+            float best = inf;
+            forEachNeighbor(m_graph, node, [&](int nb) {
+                const float cost = stepCost(node, nb) + m_g[nb];
+                if (cost < best) {
+                    best = cost;
+                    next = nb;
+                }
+            });
+            assert(next >= 0);
+            node = next;
+            result.emplace_back(m_graph, node % width, node / width);
+        }
+    }
+
+    if (stats)
+        stats->endSearch();
+    return result;
+}
+
+void DStarLite::move(const Position &position) {
+    // Keys queued so far are based on the old position. Raising all new keys by at most the
+    // heuristic between both keeps the old ones lower bounds.
+    m_keyModifier += GraphMoves::distance(m_start, position);
+    m_start = position;
+}
+
+void DStarLite::costsChanged(const std::vector<int> &nodes) {
+    const int goal = m_goal.y * m_graph.width() + m_goal.x;
+
+    // The step costs of all edges of a changed node may differ now.
+    auto update = [&](int node) {
+        if (node != goal)
+            m_rhs[node] = bestSuccessor(node);
+        updateNode(node);
+    };
+
+    for (const auto node : nodes) {
+        update(node);
+        forEachNeighbor(m_graph, node, update);
+    }
+}
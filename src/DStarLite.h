@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Graph.h"
+#include "Node.h"
+#include "Position.h"
+#include "PriorityQueue.h"
+#include "SearchStats.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Incremental replanning for one agent on a graph whose costs change, see Koenig and Likhachev,
+// "D* Lite". The search runs backwards from the goal and is kept between calls, so after the agent
+// moves or costs change only the affected part of it is repaired. One instance per agent; the
+// graph must outlive it.
+class DStarLite {
+public:
+    DStarLite(const Graph &graph, const Position &start, const Position &goal);
+
+    // Shortest path from the current position to the goal, empty if there is none. Repairs the
+    // search first if needed. Pass stats to count the expansions of the repair.
+    std::vector<Node> path(CpuSearchStats *stats = nullptr);
+
+    // The agent is now at position, usually a few steps further along the last path.
+    void move(const Position &position);
+
+    // The costs of these nodes (indices y * width + x) have been changed in the graph.
+    void costsChanged(const std::vector<int> &nodes);
+
+    const Position &position() const { return m_start; }
+    const Position &goal() const { return m_goal; }
+
+private:
+    using Key = std::pair<float, float>;
+
+    struct OpenEntry {
+        OpenEntry(Key _key, int _node) : key(_key), node(_node) {}
+
+        Key key;
+        int node;
+    };
+
+    // Comparator to put smallest keys first.
+    struct Compare {
+        bool operator()(const OpenEntry &a, const OpenEntry &b) { return a.key > b.key; }
+    };
+
+    Key   calculateKey(int node) const;
+    float heuristic(int node) const; // from the current position
+    float stepCost(int from, int to) const;
+    float bestSuccessor(int node) const; // min over successors of step cost + g
+    void  updateNode(int node);
+    Key   topKey(); // drops outdated entries on the way
+
+    template <typename Stats>
+    void computeShortestPath(Stats &stats);
+
+    const Graph &m_graph;
+    Position     m_start;
+    Position     m_goal;
+    float        m_keyModifier = 0.0f; // sum of the heuristic over all moves
+
+    std::vector<float>                m_g;
+    std::vector<float>                m_rhs;     // one-step lookahead of g
+    std::vector<Key>                  m_openKey; // key of the valid open list entry per node
+    std::vector<std::uint8_t>         m_open;    // node has a valid open list entry
+    PriorityQueue<OpenEntry, Compare> m_queue;   // outdated entries are skipped
+};
@@ -0,0 +1,182 @@
+#include "Expansion.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define EXPANSION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2 // MSVC compiles intrinsics of any instruction set without flags
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+constexpr int Expansion::dx[8];
+constexpr int Expansion::dy[8];
+
+namespace {
+const float sqrt2 = 1.41421356237f;
+const float inf = std::numeric_limits<float>::infinity();
+
+// Factor of the step cost per neighbor, diagonal moves are longer
+const float stepFactors[8] = {sqrt2, 1.0f, sqrt2, 1.0f, 1.0f, sqrt2, 1.0f, sqrt2};
+
+bool interior(int width, int height, int x, int y) {
+    return x > 0 && y > 0 && x < width - 1 && y < height - 1;
+}
+} // namespace
+
+void expandScalar(const float *costs, int width, int height, int x, int y, float totalCost,
+                  int destinationX, int destinationY, Expansion &expansion) {
+    const float cost = costs[y * width + x];
+
+    for (int i = 0; i < 8; ++i) {
+        const int nbX = x + Expansion::dx[i];
+        const int nbY = y + Expansion::dy[i];
+
+        if (nbX < 0 || nbY < 0 || nbX >= width || nbY >= height) {
+            expansion.totalCosts[i] = inf;
+            expansion.heuristics[i] = inf;
+            continue;
+        }
+
+        const float stepCost = std::max(cost, costs[nbY * width + nbX]) * stepFactors[i];
+        expansion.totalCosts[i] = totalCost + stepCost;
+
+        const int distX = std::abs(destinationX - nbX);
+        const int distY = std::abs(destinationY - nbY);
+        expansion.heuristics[i] = (distX + distY) + (sqrt2 - 2) * std::min(distX, distY);
+    }
+}
+
+#ifdef EXPANSION_X86
+// Two halves of four neighbors each. Cells at the border go the scalar way, so no bounds checks.
+void expandSse(const float *costs, int width, int height, int x, int y, float totalCost,
+               int destinationX, int destinationY, Expansion &expansion) {
+    if (!interior(width, height, x, y))
+        return expandScalar(costs, width, height, x, y, totalCost, destinationX, destinationY,
+                            expansion);
+
+    const float *above = costs + (y - 1) * width + x;
+    const float *row = costs + y * width + x;
+    const float *below = costs + (y + 1) * width + x;
+
+    const __m128 cost = _mm_set1_ps(*row);
+    const __m128 g = _mm_set1_ps(totalCost);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 diagonalFactor = _mm_set1_ps(sqrt2 - 2);
+
+    const __m128 neighbors[2] = {_mm_setr_ps(above[-1], above[0], above[1], row[-1]),
+                                 _mm_setr_ps(row[1], below[-1], below[0], below[1])};
+
+    for (int half = 0; half < 2; ++half) {
+        const int i = half * 4;
+
+        // g + max(cost, neighbor cost) * step factor
+        const __m128 step = _mm_mul_ps(_mm_max_ps(cost, neighbors[half]),
+                                       _mm_loadu_ps(stepFactors + i));
+        _mm_store_ps(expansion.totalCosts + i, _mm_add_ps(g, step));
+
+        // Octile distance: dx + dy + (sqrt2 - 2) * min(dx, dy)
+        const __m128 distX = _mm_andnot_ps(
+            signMask, _mm_setr_ps((float) (destinationX - x - Expansion::dx[i]),
+                                  (float) (destinationX - x - Expansion::dx[i + 1]),
+                                  (float) (destinationX - x - Expansion::dx[i + 2]),
+                                  (float) (destinationX - x - Expansion::dx[i + 3])));
+        const __m128 distY = _mm_andnot_ps(
+            signMask, _mm_setr_ps((float) (destinationY - y - Expansion::dy[i]),
+                                  (float) (destinationY - y - Expansion::dy[i + 1]),
+                                  (float) (destinationY - y - Expansion::dy[i + 2]),
+                                  (float) (destinationY - y - Expansion::dy[i + 3])));
+        const __m128 heuristic = _mm_add_ps(_mm_add_ps(distX, distY),
+                                            _mm_mul_ps(diagonalFactor, _mm_min_ps(distX, distY)));
+        _mm_store_ps(expansion.heuristics + i, heuristic);
+    }
+}
+
+// All eight neighbors in one register
+TARGET_AVX2 void expandAvx2(const float *costs, int width, int height, int x, int y,
+                            float totalCost, int destinationX, int destinationY,
+                            Expansion &expansion) {
+    if (!interior(width, height, x, y))
+        return expandScalar(costs, width, height, x, y, totalCost, destinationX, destinationY,
+                            expansion);
+
+    const __m256i offsetX = _mm256_loadu_si256((const __m256i *) Expansion::dx);
+    const __m256i offsetY = _mm256_loadu_si256((const __m256i *) Expansion::dy);
+
+    const float *above = costs + (y - 1) * width + x;
+    const float *row = costs + y * width + x;
+    const float *below = costs + (y + 1) * width + x;
+
+    // Plain loads rather than a gather, which is microcoded on many CPUs
+    const __m256 neighbors = _mm256_setr_ps(above[-1], above[0], above[1], row[-1], row[1],
+                                            below[-1], below[0], below[1]);
+
+    // g + max(cost, neighbor cost) * step factor
+    const __m256 step = _mm256_mul_ps(_mm256_max_ps(_mm256_set1_ps(*row), neighbors),
+                                      _mm256_loadu_ps(stepFactors));
+    _mm256_store_ps(expansion.totalCosts, _mm256_add_ps(_mm256_set1_ps(totalCost), step));
+
+    // Octile distance: dx + dy + (sqrt2 - 2) * min(dx, dy)
+    const __m256i distXi =
+        _mm256_abs_epi32(_mm256_sub_epi32(_mm256_set1_epi32(destinationX - x), offsetX));
+    const __m256i distYi =
+        _mm256_abs_epi32(_mm256_sub_epi32(_mm256_set1_epi32(destinationY - y), offsetY));
+    const __m256 distX = _mm256_cvtepi32_ps(distXi);
+    const __m256 distY = _mm256_cvtepi32_ps(distYi);
+    const __m256 heuristic =
+        _mm256_add_ps(_mm256_add_ps(distX, distY),
+                      _mm256_mul_ps(_mm256_set1_ps(sqrt2 - 2), _mm256_min_ps(distX, distY)));
+    _mm256_store_ps(expansion.heuristics, heuristic);
+
+    // The caller is compiled without AVX. Dirty upper halves would slow down its SSE code.
+    _mm256_zeroupper();
+}
+
+bool hasSse() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] >> 25) & 1;
+#else
+    return __builtin_cpu_supports("sse");
+#endif
+}
+
+bool hasAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1; // assumes an OS with AVX state support, like all current ones
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+// No x86: everything falls back to the scalar version.
+void expandSse(const float *costs, int width, int height, int x, int y, float totalCost,
+               int destinationX, int destinationY, Expansion &expansion) {
+    expandScalar(costs, width, height, x, y, totalCost, destinationX, destinationY, expansion);
+}
+
+void expandAvx2(const float *costs, int width, int height, int x, int y, float totalCost,
+                int destinationX, int destinationY, Expansion &expansion) {
+    expandScalar(costs, width, height, x, y, totalCost, destinationX, destinationY, expansion);
+}
+
+bool hasSse() { return false; }
+bool hasAvx2() { return false; }
+#endif
+
+ExpandFunction expandFunction() {
+    static const ExpandFunction function = hasAvx2() ? expandAvx2 : hasSse() ? expandSse
+                                                                             : expandScalar;
+    return function;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <limits>
+
+// Expansion of one cell of the 8-connected grid: tentative g-values and octile heuristics of all
+// neighbors at once. Neighbors are numbered row by row through the 3x3 neighborhood, skipping the
+// center, like the moves in gpuAStar.cl:
+//   0 1 2
+//   3 - 4
+//   5 6 7
+struct alignas(32) Expansion {
+    static constexpr int dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    static constexpr int dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+
+    // Infinity for neighbors outside the grid
+    float totalCosts[8]; // g + step cost, same as Graph::pathCost()
+    float heuristics[8]; // octile distance to the destination, same as in the kernels
+};
+
+// costs: one float per cell, row by row. Must not be called for cells outside the grid.
+using ExpandFunction = void (*)(const float *costs, int width, int height, int x, int y,
+                                float totalCost, int destinationX, int destinationY,
+                                Expansion &expansion);
+
+void expandScalar(const float *costs, int width, int height, int x, int y, float totalCost,
+                  int destinationX, int destinationY, Expansion &expansion);
+void expandSse(const float *costs, int width, int height, int x, int y, float totalCost,
+               int destinationX, int destinationY, Expansion &expansion);
+void expandAvx2(const float *costs, int width, int height, int x, int y, float totalCost,
+                int destinationX, int destinationY, Expansion &expansion);
+
+// Instruction sets usable on this CPU, detected at runtime
+bool hasSse();
+bool hasAvx2();
+
+// Fastest implementation for this CPU
+ExpandFunction expandFunction();
@@ -1,19 +1,53 @@
 #include "Graph.h"
 
+#include "Connectivity.h"
 #include "Node.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
-Graph::Graph(int width, int height) : m_width(width), m_height(height) {
+constexpr float Graph::infinity;
+
+namespace {
+// Source of Graph::version(), unique over all graphs
+std::atomic<std::uint64_t> nextVersion{0};
+
+// The ring of the eight cells around a cell, clockwise from the top left
+const int ringX[8] = {-1, 0, 1, 1, 1, 0, -1, -1};
+const int ringY[8] = {-1, -1, -1, 0, 1, 1, 1, 0};
+
+bool adjacent(int dx, int dy) {
+#ifdef GRAPH_DIAGONAL_MOVEMENT
+    return std::abs(dx) <= 1 && std::abs(dy) <= 1;
+#else
+    return std::abs(dx) + std::abs(dy) == 1;
+#endif
+}
+} // namespace
+
+Graph::Graph(int width, int height)
+    : m_width(width), m_height(height), m_version(++nextVersion) {
     // Set default cost for each node to 1.0f
     m_costs.resize(width * height, 1.0f);
 }
 
+Graph::Graph(int width, int height, std::vector<float> costs)
+    : m_width(width), m_height(height), m_version(++nextVersion), m_costs(std::move(costs)) {
+    assert(m_costs.size() == (std::size_t) width * height);
+}
+
 void Graph::generateObstacles(int amount) {
+    assert(!quantized()); // obstacles are added to float costs only
+    m_version = ++nextVersion;
+
 #if 1
     std::random_device rd;
 #else
@@ -44,6 +78,294 @@ void Graph::generateObstacles(int amount) {
     }
 }
 
+void Graph::quantizeCosts(int bits) {
+    assert(bits == 8 || bits == 16);
+    assert(!quantized());
+    m_version = ++nextVersion; // costs are rounded up
+
+    // Pick the smallest power of two as scale that still fits the maximum cost into the available
+    // levels. Dividing by a power of two is exact, so is multiplying the levels back.
+    float maxCost = 1.0f;
+    for (const auto cost : m_costs)
+        if (cost != infinity)
+            maxCost = std::max(maxCost, cost);
+    const float levels = (float) ((1 << bits) - 2); // the highest one marks blocked cells
+    m_costScale = std::exp2(std::ceil(std::log2(maxCost / levels)));
+
+    auto quantize = [&](float cost) {
+        return cost == infinity ? levels + 1.0f : std::max(1.0f, std::ceil(cost / m_costScale));
+    };
+
+    if (bits == 8) {
+        m_costs8.reserve(m_costs.size());
+        for (const auto cost : m_costs)
+            m_costs8.push_back((std::uint8_t) quantize(cost));
+    } else {
+        m_costs16.reserve(m_costs.size());
+        for (const auto cost : m_costs)
+            m_costs16.push_back((std::uint16_t) quantize(cost));
+    }
+
+    m_costBits = bits;
+
+    // Free the float costs to actually save the memory.
+    m_costs.clear();
+    m_costs.shrink_to_fit();
+}
+
+void Graph::setCost(int index, float cost) {
+    assert(index >= 0 && index < size());
+
+    // The highest level marks blocked cells, finite costs must stay below it.
+    const float blockedLevel = m_costBits == 8 ? 255.0f : 65535.0f;
+    const float level =
+        cost == infinity ? blockedLevel : std::max(1.0f, std::ceil(cost / m_costScale));
+    if (quantized() && cost != infinity && level >= blockedLevel)
+        throw std::out_of_range("Cost " + std::to_string(cost) + " exceeds the levels of the " +
+                                std::to_string(m_costBits) + " bit costs");
+
+    m_version = ++nextVersion;
+    const bool wasBlocked = blocked(index);
+    switch (m_costBits) {
+    case 8: m_costs8[index] = (std::uint8_t) level; break;
+    case 16: m_costs16[index] = (std::uint16_t) level; break;
+    default: m_costs[index] = cost;
+    }
+
+    if (componentsIndexed() && wasBlocked != blocked(index)) {
+        if (wasBlocked)
+            openCell(index);
+        else
+            blockCell(index);
+    }
+}
+
+void Graph::indexComponents(unsigned threads) {
+    const unsigned workerCount =
+        threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    const int stripes = std::max(1, std::min((int) workerCount, m_height));
+
+    // Union-find over the cells, a root is the smallest index of its set
+    std::vector<int> parents(size());
+    auto             find = [&](int cell) {
+        while (parents[cell] != cell)
+            cell = parents[cell] = parents[parents[cell]];
+        return cell;
+    };
+    auto unite = [&](int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a != b)
+            parents[std::max(a, b)] = std::min(a, b);
+    };
+
+    // Join every cell with its passable neighbors before it from firstRow on. Sets never reach
+    // into other stripes, so these can run in parallel.
+    auto joinRow = [&](int y, int firstRow) {
+        for (int x = 0; x < m_width; ++x) {
+            const int cell = y * m_width + x;
+            if (blocked(cell))
+                continue;
+            for (int move = 0; move < GraphMoves::moveCount; ++move) {
+                const int nbX = x + GraphMoves::moveX(move), nbY = y + GraphMoves::moveY(move);
+                const int nbCell = nbY * m_width + nbX;
+                if (nbCell < cell && nbY >= firstRow && nbX >= 0 && nbX < m_width &&
+                    !blocked(nbCell))
+                    unite(cell, nbCell);
+            }
+        }
+    };
+
+    auto firstRow = [&](int stripe) { return (int) ((long long) m_height * stripe / stripes); };
+    auto runStripes = [&](const std::function<void(int, int)> &work) {
+        std::vector<std::thread> pool;
+        for (int stripe = 1; stripe < stripes; ++stripe)
+            pool.emplace_back(work, firstRow(stripe), firstRow(stripe + 1));
+        work(firstRow(0), firstRow(1));
+        for (auto &thread : pool)
+            thread.join();
+    };
+
+    runStripes([&](int begin, int end) {
+        for (int cell = begin * m_width; cell < end * m_width; ++cell)
+            parents[cell] = cell;
+        for (int y = begin; y < end; ++y)
+            joinRow(y, begin);
+    });
+
+    // Stitch the stripes together along their first rows
+    for (int stripe = 1; stripe < stripes; ++stripe)
+        joinRow(firstRow(stripe), 0);
+
+    // Roots become labels, read only from here on
+    m_components.assign(size(), -1);
+    runStripes([&](int begin, int end) {
+        for (int cell = begin * m_width; cell < end * m_width; ++cell) {
+            if (blocked(cell))
+                continue;
+            int root = cell;
+            while (parents[root] != root)
+                root = parents[root];
+            m_components[cell] = root;
+        }
+    });
+
+    // Number the labels densely
+    m_componentSizes.clear();
+    m_freeComponents.clear();
+    std::fill(parents.begin(), parents.end(), -1); // now root to label
+    for (auto &component : m_components) {
+        if (component < 0)
+            continue;
+        if (parents[component] < 0) {
+            parents[component] = (int) m_componentSizes.size();
+            m_componentSizes.push_back(0);
+        }
+        component = parents[component];
+        ++m_componentSizes[component];
+    }
+}
+
+void Graph::openCell(int index) {
+    const int x = index % m_width, y = index / m_width;
+
+    // Distinct components around, with one cell each
+    std::vector<std::pair<int, int>> around;
+    for (int move = 0; move < GraphMoves::moveCount; ++move) {
+        const int nbX = x + GraphMoves::moveX(move), nbY = y + GraphMoves::moveY(move);
+        if (nbX < 0 || nbY < 0 || nbX >= m_width || nbY >= m_height)
+            continue;
+
+        const int  component = m_components[nbY * m_width + nbX];
+        const auto known = [&](const std::pair<int, int> &other) {
+            return other.first == component;
+        };
+        if (component >= 0 && std::none_of(around.begin(), around.end(), known))
+            around.emplace_back(component, nbY * m_width + nbX);
+    }
+
+    if (around.empty()) {
+        const int component = newComponent();
+        m_components[index] = component;
+        m_componentSizes[component] = 1;
+        return;
+    }
+
+    // Only the smaller components are relabeled.
+    const auto smaller = [&](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+        return m_componentSizes[a.first] < m_componentSizes[b.first];
+    };
+    const int largest = std::max_element(around.begin(), around.end(), smaller)->first;
+    m_components[index] = largest;
+    ++m_componentSizes[largest];
+    for (const auto &other : around) {
+        if (other.first == largest)
+            continue;
+        m_componentSizes[largest] += relabel(other.second, other.first, largest);
+        m_componentSizes[other.first] = 0;
+        m_freeComponents.push_back(other.first);
+    }
+}
+
+void Graph::blockCell(int index) {
+    const int x = index % m_width, y = index / m_width;
+    const int component = m_components[index];
+    m_components[index] = -1;
+    if (--m_componentSizes[component] == 0) {
+        m_freeComponents.push_back(component);
+        return;
+    }
+
+    // Group the passable cells of the ring around by adjacency among themselves. Neighbors in one
+    // group stay connected without the cell, which is the common case.
+    int  groups[8];
+    bool passable[8];
+    for (int i = 0; i < 8; ++i) {
+        const int cellX = x + ringX[i], cellY = y + ringY[i];
+        passable[i] = cellX >= 0 && cellY >= 0 && cellX < m_width && cellY < m_height &&
+                      m_components[cellY * m_width + cellX] >= 0;
+        groups[i] = i;
+    }
+
+    auto find = [&](int i) {
+        while (groups[i] != i)
+            i = groups[i];
+        return i;
+    };
+    for (int i = 0; i < 8; ++i)
+        for (int j = i + 1; j < 8; ++j)
+            if (passable[i] && passable[j] &&
+                adjacent(ringX[i] - ringX[j], ringY[i] - ringY[j]))
+                groups[find(j)] = find(i);
+
+    // One neighbor of the cell per group
+    std::vector<int> starts, seen;
+    for (int i = 0; i < 8; ++i) {
+        if (!passable[i] || !adjacent(ringX[i], ringY[i]))
+            continue;
+        if (std::find(seen.begin(), seen.end(), find(i)) != seen.end())
+            continue;
+        seen.push_back(find(i));
+        starts.push_back((y + ringY[i]) * m_width + x + ringX[i]);
+    }
+
+    // The groups may still be connected elsewhere. All but the last one that no earlier flood
+    // reached get a new label, the last one keeps the old.
+    for (std::size_t i = 0; i + 1 < starts.size(); ++i) {
+        if (m_components[starts[i]] != component)
+            continue;
+        const int part = newComponent();
+        const int cells = relabel(starts[i], component, part);
+        m_componentSizes[part] = cells;
+        m_componentSizes[component] -= cells;
+    }
+    if (m_componentSizes[component] == 0)
+        m_freeComponents.push_back(component);
+}
+
+int Graph::newComponent() {
+    if (!m_freeComponents.empty()) {
+        const int component = m_freeComponents.back();
+        m_freeComponents.pop_back();
+        return component;
+    }
+    m_componentSizes.push_back(0);
+    return (int) m_componentSizes.size() - 1;
+}
+
+int Graph::relabel(int start, int from, int to) {
+    std::vector<int> stack = {start};
+    m_components[start] = to;
+
+    int cells = 0;
+    while (!stack.empty()) {
+        const int cell = stack.back();
+        stack.pop_back();
+        ++cells;
+
+        const int x = cell % m_width, y = cell / m_width;
+        for (int move = 0; move < GraphMoves::moveCount; ++move) {
+            const int nbX = x + GraphMoves::moveX(move), nbY = y + GraphMoves::moveY(move);
+            if (nbX < 0 || nbY < 0 || nbX >= m_width || nbY >= m_height)
+                continue;
+            const int nbCell = nbY * m_width + nbX;
+            if (m_components[nbCell] == from) {
+                m_components[nbCell] = to;
+                stack.push_back(nbCell);
+            }
+        }
+    }
+    return cells;
+}
+
+const void *Graph::costData() const {
+    switch (m_costBits) {
+    case 8: return m_costs8.data();
+    case 16: return m_costs16.data();
+    default: return m_costs.data();
+    }
+}
+
 void Graph::toPfm(const std::string &filePath, const std::vector<Node> &path) const {
     // http://netpbm.sourceforge.net/doc/pfm.html
     std::ofstream out(filePath, std::ios::binary | std::ios::trunc);
@@ -66,7 +388,7 @@ void Graph::toPfm(const std::string &filePath, const std::vector<Node> &path) co
     // Draw graph
     for (int row = m_height - 1; row >= 0; --row) {
         for (int col = 0; col < m_width; ++col) {
-            const float brightness = 1.0f / m_costs[row * m_width + col];
+            const float brightness = 1.0f / cost(row * m_width + col);
             raster.emplace_back(0.0f, brightness, brightness);
         }
     }
@@ -95,14 +417,14 @@ float Graph::pathCost(const Node &source, const Node &destination) const {
     assert((std::abs(src.x - dst.x) == 1 && src.y == dst.y) ||
            (std::abs(src.y - dst.y) == 1 && src.x == dst.x));
 
-    return std::max(m_costs[src.y * m_width + src.x], m_costs[dst.y * m_width + dst.x]);
+    return std::max(cost(src.y * m_width + src.x), cost(dst.y * m_width + dst.x));
 #else
     // Diagonal connections as well
     assert(std::abs(src.x - dst.x) <= 1 && std::abs(src.y - dst.y) <= 1);
 
     const bool diagonal = src.x != dst.x && src.y != dst.y;
-    const auto cost = std::max(m_costs[src.y * m_width + src.x], m_costs[dst.y * m_width + dst.x]);
+    const auto stepCost = std::max(cost(src.y * m_width + src.x), cost(dst.y * m_width + dst.x));
     constexpr float sqrt2 = 1.41421356237f;
-    return diagonal ? sqrt2 * cost : cost;
+    return diagonal ? sqrt2 * stepCost : stepCost;
 #endif
 }
@@ -2,27 +2,97 @@
 
 #define GRAPH_DIAGONAL_MOVEMENT
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <vector>
 
 class Node;
 
+// Grid of per-cell costs. Cells of infinite cost are impassable: searches neither enter nor leave
+// them.
 class Graph {
 public:
     Graph(int width, int height);
+    Graph(int width, int height, std::vector<float> costs); // costs row by row
 
     void generateObstacles(int amount = 10);
 
+    // Store costs as 8 or 16 bit levels of a common power-of-two scale. Costs are rounded up, so
+    // they never drop below their original value and the heuristics stay admissible. All searches
+    // remain exact in the quantized cost domain. The highest level marks impassable cells.
+    void quantizeCosts(int bits = 8);
+
     void toPfm(const std::string &filePath, const std::vector<Node> &path = {}) const;
 
     float pathCost(const Node &source, const Node &destination) const;
 
+    float cost(int index) const {
+        switch (m_costBits) {
+        case 8: return m_costs8[index] != 0xff ? m_costs8[index] * m_costScale : infinity;
+        case 16: return m_costs16[index] != 0xffff ? m_costs16[index] * m_costScale : infinity;
+        default: return m_costs[index];
+        }
+    }
+
+    bool blocked(int index) const { return cost(index) == infinity; }
+
+    // Change the cost of one node. Quantized graphs round up to the next level and throw
+    // std::out_of_range for finite costs beyond the highest level below the one of blocked cells.
+    // Keeps the component index up to date.
+    void setCost(int index, float cost);
+
+    // Label the connected components of the passable cells, in stripes of rows on threads
+    // (threads = 0 uses one per hardware thread). From then on setCost() keeps the labels up to
+    // date: opening a cell merges the components around it into the largest one, blocking a cell
+    // relabels its component only if it falls apart.
+    void indexComponents(unsigned threads = 0);
+    bool componentsIndexed() const { return !m_components.empty(); }
+
+    // Label of the component of a cell, -1 if blocked. Needs indexComponents().
+    int component(int index) const { return m_components[index]; }
+
+    // Whether a path between two cells may exist, in O(1). Without a component index only blocked
+    // cells are ruled out.
+    bool connected(int a, int b) const {
+        if (!componentsIndexed())
+            return !blocked(a) && !blocked(b);
+        return m_components[a] >= 0 && m_components[a] == m_components[b];
+    }
+
+    // Raw cost storage, e.g. for uploading to a device: costBits() / 8 bytes per node, each value
+    // multiplied by costScale() gives the actual cost.
+    const void *costData() const;
+    int         costBits() const { return m_costBits; }
+    float       costScale() const { return m_costScale; }
+    bool        quantized() const { return m_costBits != 32; }
+
+    // Changes with every change of the costs. Graphs of equal versions have equal costs, copies
+    // keep theirs, so it identifies a map e.g. in caches.
+    std::uint64_t version() const { return m_version; }
+
     int width() const { return m_width; }
     int height() const { return m_height; }
     int size() const { return m_width * m_height; }
 
 private:
-    int                m_width;
-    int                m_height;
-    std::vector<float> m_costs;
+    static constexpr float infinity = std::numeric_limits<float>::infinity();
+
+    void openCell(int index);
+    void blockCell(int index);
+    int  newComponent();
+    int  relabel(int start, int from, int to); // flood fill, returns the number of cells
+
+    int                        m_width;
+    int                        m_height;
+    std::uint64_t              m_version;
+    int                        m_costBits = 32;
+    float                      m_costScale = 1.0f;
+    std::vector<float>         m_costs;   // only one of these is in use,
+    std::vector<std::uint8_t>  m_costs8;  // depending on m_costBits
+    std::vector<std::uint16_t> m_costs16;
+
+    std::vector<int> m_components;     // label per cell, empty if not indexed
+    std::vector<int> m_componentSizes; // cells per label
+    std::vector<int> m_freeComponents; // labels of size 0, for reuse
 };
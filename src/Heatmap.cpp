@@ -0,0 +1,118 @@
+#include "Heatmap.h"
+
+#include "Graph.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+struct RGB {
+    float r, g, b;
+};
+
+// The map like Graph::toPfm(), row by row from the bottom as PFM stores it
+std::vector<RGB> mapRaster(const Graph &graph) {
+    std::vector<RGB> raster;
+    raster.reserve(graph.size());
+    for (int row = graph.height() - 1; row >= 0; --row) {
+        for (int col = 0; col < graph.width(); ++col) {
+            const float brightness = 1.0f / graph.cost(row * graph.width() + col);
+            raster.push_back({0.0f, brightness, brightness});
+        }
+    }
+    return raster;
+}
+
+// Darken the map below a cell of the layer and put the layer value in red.
+void drawLayer(std::vector<RGB> &raster, int width, int height, std::size_t cell, float value) {
+    const int x = (int) (cell % width), y = (int) (cell / width);
+    auto &    pixel = raster[(std::size_t)(height - y - 1) * width + x];
+    pixel.r = value;
+    pixel.g /= 10;
+    pixel.b /= 10;
+}
+
+// http://netpbm.sourceforge.net/doc/pfm.html
+void writePfm(const std::string &filePath, int width, int height, const std::vector<RGB> &raster) {
+    static_assert(sizeof(RGB) == 12, "RGB type is not 12 bytes!");
+
+    std::ofstream out(filePath, std::ios::binary | std::ios::trunc);
+    out << "PF\n" << width << ' ' << height << '\n' << std::fixed << -1.0f << '\n';
+    out.write(reinterpret_cast<const char *>(raster.data()), raster.size() * sizeof(RGB));
+}
+
+template <typename T>
+void write(std::ofstream &file, const T *data, std::size_t count = 1) {
+    file.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+}
+} // namespace
+
+void Heatmap::add(const std::vector<std::uint32_t> &counts) {
+    assert(counts.size() == m_counts.size());
+    for (std::size_t i = 0; i < m_counts.size(); ++i)
+        m_counts[i] += counts[i];
+}
+
+void Heatmap::add(const Heatmap &other) {
+    add(other.m_counts);
+    m_frontiers.insert(m_frontiers.end(), other.m_frontiers.begin(), other.m_frontiers.end());
+}
+
+void Heatmap::clear() {
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_frontiers.clear();
+}
+
+std::uint64_t Heatmap::total() const {
+    return std::accumulate(m_counts.begin(), m_counts.end(), (std::uint64_t) 0);
+}
+
+void Heatmap::toPfm(const std::string &filePath, const Graph &graph) const {
+    assert(graph.width() == m_width && graph.height() == m_height);
+
+    // Most cells are expanded once or not at all, a few very often.
+    const auto  maxCount = *std::max_element(m_counts.begin(), m_counts.end());
+    const float scale = maxCount > 0 ? 1.0f / std::log1p((float) maxCount) : 0.0f;
+
+    auto raster = mapRaster(graph);
+    for (std::size_t cell = 0; cell < m_counts.size(); ++cell)
+        if (m_counts[cell] != 0)
+            drawLayer(raster, m_width, m_height, cell,
+                      0.1f + 0.9f * std::log1p((float) m_counts[cell]) * scale);
+
+    writePfm(filePath, m_width, m_height, raster);
+}
+
+void Heatmap::frontierToPfm(const std::string &filePath, const Graph &graph,
+                            std::size_t iteration) const {
+    assert(graph.width() == m_width && graph.height() == m_height);
+
+    auto raster = mapRaster(graph);
+    for (const auto cell : m_frontiers.at(iteration))
+        drawLayer(raster, m_width, m_height, cell, 1.0f);
+
+    writePfm(filePath, m_width, m_height, raster);
+}
+
+void Heatmap::save(const std::string &filePath) const {
+    std::ofstream file(filePath, std::ios::binary);
+
+    const std::uint32_t header[4] = {magic, version, (std::uint32_t) m_width,
+                                     (std::uint32_t) m_height};
+    const auto          frontierCount = (std::uint32_t) m_frontiers.size();
+    write(file, header, 4);
+    write(file, m_counts.data(), m_counts.size());
+    write(file, &frontierCount);
+    for (const auto &frontier : m_frontiers) {
+        const auto size = (std::uint32_t) frontier.size();
+        write(file, &size);
+        write(file, frontier.data(), frontier.size());
+    }
+
+    if (!file)
+        throw std::runtime_error("Writing " + filePath + " failed");
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Graph;
+
+// Where searches spent their work: expansions per cell, summed over all searches, and the
+// frontier (the cells in any open list) after every iteration of GA*. Pass one along with the
+// search stats, see SearchStats.h. It must have the dimensions of the searched graph; GPU searches
+// on other graphs leave it untouched. Not thread-safe, parallel engines merge per thread counts.
+class Heatmap {
+public:
+    Heatmap(int width, int height)
+        : m_width(width), m_height(height), m_counts((std::size_t) width * height, 0) {}
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    void expanded(std::int64_t cell) {
+        if (cell >= 0 && (std::uint64_t) cell < m_counts.size())
+            ++m_counts[(std::size_t) cell];
+    }
+
+    // Expansions per cell, e.g. downloaded from the device
+    void add(const std::vector<std::uint32_t> &counts);
+    void add(const Heatmap &other);
+
+    void addFrontier(std::vector<std::uint32_t> cells) { m_frontiers.push_back(std::move(cells)); }
+
+    void clear();
+
+    const std::vector<std::uint32_t> &             counts() const { return m_counts; }
+    const std::vector<std::vector<std::uint32_t>> &frontiers() const { return m_frontiers; }
+    std::uint64_t                                  total() const;
+
+    // PFM layers over the map as drawn by Graph::toPfm(): the expansions on a logarithmic scale,
+    // or the frontier after one iteration, in red.
+    void toPfm(const std::string &filePath, const Graph &graph) const;
+    void frontierToPfm(const std::string &filePath, const Graph &graph,
+                       std::size_t iteration) const;
+
+    // Compact binary stream, all in host byte order: magic, version, width, height (32 bit each),
+    // the counts (width * height, 32 bit each), the number of frontiers (32 bit), then every
+    // frontier as its size and cells (32 bit each).
+    void save(const std::string &filePath) const;
+
+private:
+    static const std::uint32_t magic = 0x504d484f; // "OHMP"
+    static const std::uint32_t version = 1;
+
+    int                                     m_width;
+    int                                     m_height;
+    std::vector<std::uint32_t>              m_counts;
+    std::vector<std::vector<std::uint32_t>> m_frontiers;
+};
@@ -0,0 +1,158 @@
+#include "PathCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::size_t PathCache::Hash::operator()(const Key &key) const {
+    std::uint32_t weight;
+    std::memcpy(&weight, &key.weight, sizeof(weight));
+
+    std::uint64_t hash = key.version * 0x9e3779b97f4a7c15ull;
+    for (const std::uint64_t value : {(std::uint64_t) weight, (std::uint64_t) key.first,
+                                      (std::uint64_t) key.second})
+        hash = (hash ^ value) * 0x100000001b3ull;
+    return (std::size_t)(hash ^ (hash >> 32));
+}
+
+bool PathCache::find(const Key &key, std::vector<PathSet::Cell> &cells, PathSet::Status &status) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    cells = it->second->cells;
+    status = it->second->status;
+    return true;
+}
+
+void PathCache::insert(const Key &key, const PathSet::Path &path, PathSet::Status status) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (path.size() > m_maxCells || m_index.count(key) != 0)
+        return;
+
+    m_entries.push_front({key, {path.begin(), path.end()}, status});
+    m_index.emplace(key, m_entries.begin());
+    m_cells += path.size();
+
+    while (m_cells > m_maxCells) {
+        m_cells -= m_entries.back().cells.size();
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+    }
+}
+
+void PathCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_cells = 0;
+}
+
+std::size_t PathCache::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+std::uint64_t PathCache::hits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+std::uint64_t PathCache::misses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+PathSet searchUnique(
+    const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+    float weight, PathCache *cache,
+    const std::function<PathSet(const std::vector<std::pair<Position, Position>> &)> &search) {
+    const int width = graph.width();
+    auto      index = [width](const Position &p) { return (PathSet::Cell)(p.y * width + p.x); };
+
+    // Every query refers to the answer of its canonical pair: a cached path, or one of the
+    // searched ones.
+    struct Answer {
+        std::vector<PathSet::Cell> cells; // cached
+        PathSet::Status            status = PathSet::NoPath;
+        std::size_t                searched = SIZE_MAX; // index into the searched paths
+    };
+
+    std::vector<Answer>                                answers;
+    std::vector<std::size_t>                           answerOf(srcDstList.size(), SIZE_MAX);
+    std::vector<char>                                  reversed(srcDstList.size(), 0);
+    std::unordered_map<std::uint64_t, std::size_t>     answerIndex;
+    std::vector<std::pair<Position, Position>>         searchList;
+    std::vector<PathCache::Key>                        searchKeys;
+
+    for (std::size_t i = 0; i < srcDstList.size(); ++i) {
+        const auto source = index(srcDstList[i].first);
+        const auto destination = index(srcDstList[i].second);
+        if (!graph.connected((int) source, (int) destination))
+            continue; // no answer: no path
+
+        reversed[i] = destination < source;
+        const auto first = std::min(source, destination), second = std::max(source, destination);
+
+        const auto pair = (std::uint64_t) first << 32 | second;
+        const auto known = answerIndex.find(pair);
+        if (known != answerIndex.end()) {
+            answerOf[i] = known->second;
+            continue;
+        }
+
+        answerOf[i] = answers.size();
+        answerIndex.emplace(pair, answers.size());
+        answers.emplace_back();
+
+        const PathCache::Key key = {graph.version(), weight, first, second};
+        if (cache && cache->find(key, answers.back().cells, answers.back().status))
+            continue;
+
+        // Searched in the canonical direction
+        answers.back().searched = searchList.size();
+        searchList.emplace_back(reversed[i] ? srcDstList[i].second : srcDstList[i].first,
+                                reversed[i] ? srcDstList[i].first : srcDstList[i].second);
+        searchKeys.push_back(key);
+    }
+
+    const auto found = searchList.empty() ? PathSet(width) : search(searchList);
+    if (cache)
+        for (std::size_t i = 0; i < searchList.size(); ++i)
+            cache->insert(searchKeys[i], found[i], found.status(i));
+
+    std::size_t cellCount = found.cells().size();
+    for (const auto &answer : answers)
+        cellCount += answer.cells.size();
+
+    PathSet paths(width);
+    paths.reserve(srcDstList.size(), cellCount);
+    for (std::size_t i = 0; i < srcDstList.size(); ++i) {
+        if (answerOf[i] == SIZE_MAX) {
+            paths.append(0, PathSet::NoPath);
+            continue;
+        }
+
+        const auto &answer = answers[answerOf[i]];
+        const auto *begin = answer.cells.data(), *end = begin + answer.cells.size();
+        auto        status = answer.status;
+        if (answer.searched != SIZE_MAX) {
+            const auto path = found[answer.searched];
+            begin = path.begin();
+            end = path.end();
+            status = found.status(answer.searched);
+        }
+
+        auto *cells = paths.append(end - begin, status);
+        if (reversed[i])
+            std::reverse_copy(begin, end, cells);
+        else
+            std::copy(begin, end, cells);
+    }
+    return paths;
+}
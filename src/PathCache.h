@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Graph.h"
+#include "PathSet.h"
+#include "Position.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Least recently used paths of earlier batches, for gpuAStar. Keyed by map version, search weight
+// and the canonical pair of end cells (lower index first), so reversed queries share an entry.
+// Thread-safe.
+class PathCache {
+public:
+    struct Key {
+        std::uint64_t version; // see Graph::version()
+        float         weight;
+        PathSet::Cell first, second; // first <= second
+
+        bool operator==(const Key &other) const {
+            return version == other.version && weight == other.weight && first == other.first &&
+                   second == other.second;
+        }
+    };
+
+    // Entries are evicted once all paths together hold more than maxCells cells.
+    explicit PathCache(std::size_t maxCells = 1 << 22) : m_maxCells(maxCells) {}
+
+    // The path from key.first to key.second
+    bool find(const Key &key, std::vector<PathSet::Cell> &cells, PathSet::Status &status);
+    void insert(const Key &key, const PathSet::Path &path, PathSet::Status status);
+
+    void clear();
+
+    std::size_t   size() const;
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+
+private:
+    struct Hash {
+        std::size_t operator()(const Key &key) const;
+    };
+
+    struct Entry {
+        Key                        key;
+        std::vector<PathSet::Cell> cells;
+        PathSet::Status            status;
+    };
+
+    mutable std::mutex                                         m_mutex;
+    std::size_t                                                m_maxCells;
+    std::size_t                                                m_cells = 0;
+    std::list<Entry>                                           m_entries; // most recent first
+    std::unordered_map<Key, std::list<Entry>::iterator, Hash> m_index;
+    std::uint64_t                                              m_hits = 0;
+    std::uint64_t                                              m_misses = 0;
+};
+
+// Batch front end of gpuAStar. Pairs are canonicalized so that identical and reversed queries
+// share one search, reversed ones get the path reversed, as Graph::pathCost() is symmetric.
+// Queries between components are answered without a search, cached ones from the cache. Only the
+// remaining unique queries are passed to search, which must return their paths in order. The
+// result is in the order of srcDstList.
+PathSet searchUnique(
+    const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+    float weight, PathCache *cache,
+    const std::function<PathSet(const std::vector<std::pair<Position, Position>> &)> &search);
@@ -0,0 +1,387 @@
+#include "PathDaemon.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+// Loop until everything is written or read, sockets may transfer less per call.
+bool writeAll(int fd, const void *data, std::size_t size) {
+    const auto *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        const auto written = ::write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Make the pipe poll as readable until drained.
+void wake(int fd) {
+    const char byte = 0;
+    (void) !::write(fd, &byte, 1);
+}
+
+bool readAll(int fd, void *data, std::size_t size) {
+    auto *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        const auto read = ::read(fd, bytes, size);
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read <= 0)
+            return false; // closed by the client or shut down by stop()
+        bytes += read;
+        size -= read;
+    }
+    return true;
+}
+} // namespace
+
+struct PathDaemon::Connection {
+    explicit Connection(int _fd) : fd(_fd) {}
+    ~Connection() { ::close(fd); }
+
+    // Disconnect, which also ends the reader.
+    void drop() {
+        broken = true;
+        outbox.clear();
+        written = 0;
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+    int               fd;
+    std::mutex        outboxMutex;    // responses of one client come from several threads
+    std::vector<char> outbox;         // responses not written yet
+    std::size_t       written = 0;    // bytes of the outbox written already
+    bool              writing = false; // in the writer's list
+    bool              broken = false; // a write failed or the backlog overflowed, client dropped
+    std::thread       reader;
+    std::atomic<bool> done{false}; // reader has finished
+};
+
+PathDaemon::PathDaemon(const Graph &graph, Scheduler &scheduler, Options options)
+    : m_graph(graph), m_scheduler(scheduler), m_options(std::move(options)) {
+    if (::pipe(m_stopPipe) != 0)
+        throw std::system_error(errno, std::generic_category(), "pipe");
+    if (::pipe(m_wakePipe) != 0) {
+        const auto error = errno;
+        ::close(m_stopPipe[0]);
+        ::close(m_stopPipe[1]);
+        throw std::system_error(error, std::generic_category(), "pipe");
+    }
+    // Waking the writer must never block, nor must emptying the pipe.
+    for (const int fd : m_wakePipe)
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+PathDaemon::~PathDaemon() {
+    ::close(m_stopPipe[0]);
+    ::close(m_stopPipe[1]);
+    ::close(m_wakePipe[0]);
+    ::close(m_wakePipe[1]);
+}
+
+void PathDaemon::run() {
+    // A client that went away is noticed by failing writes, not by a signal.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (m_options.socketPath.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path too long: " + m_options.socketPath);
+    std::strcpy(address.sun_path, m_options.socketPath.c_str());
+
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw std::system_error(errno, std::generic_category(), "socket");
+
+    ::unlink(m_options.socketPath.c_str()); // left over from an earlier run
+    if (::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+        const auto error = errno;
+        ::close(listener);
+        throw std::system_error(error, std::generic_category(), m_options.socketPath);
+    }
+
+    // Left set by an earlier run, no other thread is running yet.
+    m_stopping = false;
+    m_draining = false;
+    std::thread                              dispatcher(&PathDaemon::dispatch, this);
+    std::thread                              writer(&PathDaemon::write, this);
+    std::vector<std::shared_ptr<Connection>> connections;
+
+    pollfd fds[2] = {{listener, POLLIN, 0}, {m_stopPipe[0], POLLIN, 0}};
+    while (true) {
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break; // stop()
+        if ((fds[0].revents & POLLIN) == 0)
+            continue;
+
+        const int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        // Forget clients that have disconnected, queries still pending keep theirs alive.
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const std::shared_ptr<Connection> &connection) {
+                                             if (!connection->done)
+                                                 return false;
+                                             connection->reader.join();
+                                             return true;
+                                         }),
+                          connections.end());
+
+        auto connection = std::make_shared<Connection>(fd);
+        connection->reader = std::thread(&PathDaemon::serve, this, connection);
+        connections.push_back(std::move(connection));
+    }
+
+    // No more queries: unblock the readers, then answer what is still pending.
+    for (const auto &connection : connections)
+        ::shutdown(connection->fd, SHUT_RD);
+    for (const auto &connection : connections)
+        connection->reader.join();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queued.notify_all();
+    dispatcher.join();
+
+    // All answers are queued, give the clients the drain timeout to read them.
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_draining = true;
+    }
+    wake(m_wakePipe[1]);
+    writer.join();
+
+    ::close(listener);
+    ::unlink(m_options.socketPath.c_str());
+
+    // Drain the stop byte, so the daemon could run again.
+    char byte;
+    while (::poll(fds + 1, 1, 0) > 0 && ::read(m_stopPipe[0], &byte, 1) > 0)
+        ;
+}
+
+void PathDaemon::stop() {
+    const char byte = 0;
+    (void) !::write(m_stopPipe[1], &byte, 1);
+}
+
+void PathDaemon::serve(std::shared_ptr<Connection> connection) {
+    const Hello hello = {magic, (std::uint32_t) m_graph.width(), (std::uint32_t) m_graph.height()};
+    bool        connected = writeAll(connection->fd, &hello, sizeof(hello));
+
+    auto inside = [&](const Position &p) {
+        return p.x >= 0 && p.y >= 0 && p.x < m_graph.width() && p.y < m_graph.height();
+    };
+
+    Request request;
+    while (connected && readAll(connection->fd, &request, sizeof(request))) {
+        const Position source = {request.sourceX, request.sourceY};
+        const Position destination = {request.destinationX, request.destinationY};
+        if (!inside(source) || !inside(destination)) {
+            respond(connection, request.id, Invalid);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back({connection, request.id, {source, destination},
+                             std::chrono::steady_clock::now()});
+
+        // The first query starts the batch window, a full batch ends it.
+        if (m_pending.size() == 1 || m_pending.size() >= m_options.maxBatchSize)
+            m_queued.notify_one();
+    }
+
+    connection->done = true;
+}
+
+void PathDaemon::dispatch() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_queued.wait(lock, [&] { return m_stopping || !m_pending.empty(); });
+        if (m_pending.empty())
+            return; // stopping, all answered
+
+        // Give other queries until the window of the oldest one ends to join it.
+        const auto deadline = m_pending.front().arrival + m_options.batchWindow;
+        m_queued.wait_until(lock, deadline, [&] {
+            return m_stopping || m_pending.size() >= m_options.maxBatchSize;
+        });
+
+        const auto         count = std::min(m_pending.size(), m_options.maxBatchSize);
+        std::vector<Query> batch(std::make_move_iterator(m_pending.begin()),
+                                 std::make_move_iterator(m_pending.begin() + count));
+        m_pending.erase(m_pending.begin(), m_pending.begin() + count);
+        m_queries += count;
+        ++m_batches;
+        lock.unlock();
+
+        std::vector<std::pair<Position, Position>> srcDstList;
+        srcDstList.reserve(count);
+        for (const auto &query : batch)
+            srcDstList.push_back(query.srcDst);
+
+        const auto paths = m_scheduler.findPaths(srcDstList);
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto path = paths[i];
+            respond(batch[i].connection, batch[i].id,
+                    paths.status(i) == PathSet::Found ? Found : NoPath, path.begin(),
+                    (std::uint32_t) path.size());
+        }
+
+        lock.lock();
+    }
+}
+
+void PathDaemon::respond(const std::shared_ptr<Connection> &connection, std::uint32_t id,
+                         Status status, const std::uint32_t *cells, std::uint32_t length) {
+    const Response response = {id, status, length};
+    const auto     size = sizeof(response) + length * sizeof(std::uint32_t);
+
+    std::lock_guard<std::mutex> lock(connection->outboxMutex);
+    if (connection->broken)
+        return;
+    if (connection->outbox.size() - connection->written + size > m_options.maxBacklogBytes) {
+        connection->drop(); // does not read its answers
+        return;
+    }
+
+    auto &outbox = connection->outbox;
+    outbox.resize(outbox.size() + size);
+    std::memcpy(&outbox[outbox.size() - size], &response, sizeof(response));
+    if (length > 0)
+        std::memcpy(&outbox[outbox.size() - size + sizeof(response)], cells,
+                    length * sizeof(std::uint32_t));
+
+    if (!connection->writing) {
+        connection->writing = true;
+        std::lock_guard<std::mutex> writeLock(m_writeMutex);
+        m_writable.push_back(connection);
+        wake(m_wakePipe[1]);
+    }
+}
+
+void PathDaemon::write() {
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::shared_ptr<Connection>> connections; // with answers left to write
+    std::vector<pollfd>                      fds;
+    auto                                     deadline = Clock::time_point::max();
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_writeMutex);
+            connections.insert(connections.end(), m_writable.begin(), m_writable.end());
+            m_writable.clear();
+            if (m_draining && deadline == Clock::time_point::max())
+                deadline = Clock::now() + m_options.drainTimeout;
+        }
+
+        const auto now = Clock::now();
+        if (deadline != Clock::time_point::max() &&
+            (connections.empty() || now >= deadline)) {
+            // Clients that have not read their answers by now are dropped.
+            for (const auto &connection : connections) {
+                std::lock_guard<std::mutex> lock(connection->outboxMutex);
+                connection->drop();
+                connection->writing = false;
+            }
+            return;
+        }
+
+        fds.assign(1, {m_wakePipe[0], POLLIN, 0});
+        for (const auto &connection : connections)
+            fds.push_back({connection->fd, POLLOUT, 0});
+
+        using std::chrono::milliseconds;
+        int timeout = -1; // until woken up
+        if (deadline != Clock::time_point::max())
+            timeout = 1 + (int) std::chrono::duration_cast<milliseconds>(deadline - now).count();
+        if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+            return;
+
+        char bytes[64];
+        if (fds[0].revents != 0)
+            while (::read(m_wakePipe[0], bytes, sizeof(bytes)) > 0)
+                ;
+
+        // As much as every client takes without blocking, the rest waits for the next round.
+        for (std::size_t i = 0; i < connections.size(); ++i) {
+            if (fds[i + 1].revents == 0)
+                continue;
+
+            auto &                      connection = *connections[i];
+            std::lock_guard<std::mutex> lock(connection.outboxMutex);
+            while (!connection.broken && connection.written < connection.outbox.size()) {
+                const auto sent = ::send(connection.fd, &connection.outbox[connection.written],
+                                         connection.outbox.size() - connection.written,
+                                         MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR)
+                    continue;
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+                if (sent <= 0)
+                    connection.drop(); // the client is gone
+                else
+                    connection.written += sent;
+            }
+
+            if (connection.broken || connection.written == connection.outbox.size()) {
+                connection.outbox.clear();
+                connection.written = 0;
+                connection.writing = false;
+                connections[i].reset();
+            }
+        }
+        connections.erase(std::remove(connections.begin(), connections.end(), nullptr),
+                          connections.end());
+    }
+}
+#else
+struct PathDaemon::Connection {};
+
+PathDaemon::PathDaemon(const Graph &graph, Scheduler &scheduler, Options options)
+    : m_graph(graph), m_scheduler(scheduler), m_options(std::move(options)) {}
+
+PathDaemon::~PathDaemon() {}
+
+void PathDaemon::run() { throw std::runtime_error("PathDaemon needs Unix domain sockets"); }
+
+void PathDaemon::stop() {}
+#endif
+
+std::size_t PathDaemon::queries() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queries;
+}
+
+std::size_t PathDaemon::batches() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_batches;
+}
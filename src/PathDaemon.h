@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Graph.h"
+#include "Position.h"
+#include "Scheduler.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Long-running server for path queries of other processes, over a Unix domain socket. Queries of
+// all clients are collected into micro-batches, which the scheduler dispatches as one batch, and
+// every answer goes back to its client as soon as its batch is done. A query waits at most the
+// batch window for others to join it. Answers are queued per client and written by a poll loop
+// without blocking, so a client that does not read only holds up itself; once its unread answers
+// exceed the backlog limit it is disconnected.
+//
+// Protocol, all fields 32 bit in host byte order:
+// - On connect the daemon sends a Hello: magic, width and height of the map.
+// - Clients send Requests: a free to choose id, source x, y and destination x, y.
+// - For each request the daemon sends a Response: the id, a status and the path length, followed
+//   by that many cell indices (y * width + x) from source to destination.
+// Responses of one client may arrive in a different order than its requests.
+class PathDaemon {
+public:
+    struct Options {
+        std::string               socketPath = "/tmp/ocl-astar.sock";
+        std::chrono::microseconds batchWindow{2000}; // longest wait for a batch to fill
+        std::size_t               maxBatchSize = 4096; // dispatched at once when reached
+        std::size_t               maxBacklogBytes = 16 << 20; // unread answers per client
+        std::chrono::milliseconds drainTimeout{1000}; // for clients to read the last answers
+    };
+
+    static const std::uint32_t magic = 0x4f415331; // "OAS1"
+
+    enum Status : std::uint32_t { Found = 0, NoPath = 1, Invalid = 2 };
+
+    struct Hello {
+        std::uint32_t magic;
+        std::uint32_t width;
+        std::uint32_t height;
+    };
+
+    struct Request {
+        std::uint32_t id;
+        std::int32_t  sourceX, sourceY;
+        std::int32_t  destinationX, destinationY;
+    };
+
+    struct Response {
+        std::uint32_t id;
+        std::uint32_t status;
+        std::uint32_t length; // cell indices following
+    };
+
+    // The graph and scheduler must outlive the daemon.
+    PathDaemon(const Graph &graph, Scheduler &scheduler, Options options);
+    ~PathDaemon();
+
+    PathDaemon(const PathDaemon &) = delete;
+    PathDaemon &operator=(const PathDaemon &) = delete;
+
+    // Serve until stop() is called. Throws if the socket cannot be set up.
+    void run();
+
+    // Async-signal-safe, so it may be called from a signal handler.
+    void stop();
+
+    // Totals since construction
+    std::size_t queries() const;
+    std::size_t batches() const;
+
+private:
+    struct Connection;
+
+    struct Query {
+        std::shared_ptr<Connection>           connection;
+        std::uint32_t                         id;
+        std::pair<Position, Position>         srcDst;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    void serve(std::shared_ptr<Connection> connection); // one thread per client
+    void dispatch();                                    // batches queries, one thread
+    void write();                                       // writes queued answers, one thread
+    void respond(const std::shared_ptr<Connection> &connection, std::uint32_t id, Status status,
+                 const std::uint32_t *cells = nullptr, std::uint32_t length = 0);
+
+    const Graph &m_graph;
+    Scheduler &  m_scheduler;
+    Options      m_options;
+    int          m_stopPipe[2] = {-1, -1};
+    int          m_wakePipe[2] = {-1, -1}; // wakes the writer for new answers
+
+    std::mutex                               m_writeMutex; // guards the two below
+    std::vector<std::shared_ptr<Connection>> m_writable;   // with newly queued answers
+    bool                                     m_draining = false; // no more answers to come
+
+    mutable std::mutex      m_mutex; // guards everything below
+    std::condition_variable m_queued;
+    std::vector<Query>      m_pending;
+    bool                    m_stopping = false;
+    std::size_t             m_queries = 0;
+    std::size_t             m_batches = 0;
+};
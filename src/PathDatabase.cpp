@@ -0,0 +1,212 @@
+#include "PathDatabase.h"
+
+#include "Connectivity.h"
+#include "RadixHeap.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+struct OpenEntry {
+    OpenEntry(int _node, float _totalCost) : node(_node), totalCost(_totalCost) {}
+
+    int   node;
+    float totalCost; // g-value when queued, entries with outdated values are skipped
+};
+
+// Key of the radix heap, Dijkstra pops costs in increasing order
+struct Priority {
+    float operator()(const OpenEntry &entry) const { return entry.totalCost; }
+};
+
+// Runs of first moves from source to all targets, in row-major order of the targets
+void buildRow(const Graph &graph, int source, std::vector<float> &totalCosts,
+              std::vector<std::uint8_t> &firstMoves, std::vector<std::uint32_t> &runs) {
+    const int   width = graph.width(), height = graph.height();
+    const float inf = std::numeric_limits<float>::infinity();
+
+    std::fill(totalCosts.begin(), totalCosts.end(), inf);
+    std::fill(firstMoves.begin(), firstMoves.end(), 8);
+
+    RadixHeap<OpenEntry, Priority> open;
+    totalCosts[source] = 0.0f;
+    open.emplace(source, 0.0f);
+
+    while (!open.empty()) {
+        const auto current = open.top();
+        open.pop();
+        if (current.totalCost != totalCosts[current.node])
+            continue;
+
+        const int   x = current.node % width, y = current.node / width;
+        const float nodeCost = graph.cost(current.node);
+        // Numbered like EightMoves in any case, the stored first moves depend on it
+        for (int move = 0; move < EightMoves::moveCount; ++move) {
+            const bool diagonal = EightMoves::diagonal(move);
+#ifndef GRAPH_DIAGONAL_MOVEMENT
+            if (diagonal)
+                continue;
+#endif
+            const int nbX = x + EightMoves::moveX(move), nbY = y + EightMoves::moveY(move);
+            if (nbX < 0 || nbY < 0 || nbX >= width || nbY >= height)
+                continue;
+
+            // Same as Graph::pathCost()
+            const int   nbNode = nbY * width + nbX;
+            const float stepCost = std::max(nodeCost, graph.cost(nbNode));
+            const float nbTotalCost =
+                current.totalCost + (diagonal ? 1.41421356237f * stepCost : stepCost);
+            if (nbTotalCost >= totalCosts[nbNode])
+                continue;
+
+            totalCosts[nbNode] = nbTotalCost;
+            firstMoves[nbNode] = current.node == source ? move : firstMoves[current.node];
+            open.emplace(nbNode, nbTotalCost);
+        }
+    }
+
+    for (std::uint32_t target = 0; target < firstMoves.size(); ++target)
+        if (target == 0 || firstMoves[target] != firstMoves[target - 1])
+            runs.push_back(target << 4 | firstMoves[target]);
+}
+
+template <typename T>
+void write(std::ofstream &file, const T *data, std::size_t count = 1) {
+    file.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+}
+
+template <typename T>
+void read(std::ifstream &file, T *data, std::size_t count = 1) {
+    file.read(reinterpret_cast<char *>(data), count * sizeof(T));
+}
+} // namespace
+
+PathDatabase::PathDatabase(const Graph &graph, unsigned threads) : m_graph(graph) {
+    if ((std::uint64_t) graph.size() > (1u << 28))
+        throw std::length_error("Graph too large for a path database");
+
+    const unsigned workerCount =
+        threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // Every worker takes the next source, rows are concatenated afterwards.
+    std::vector<std::vector<std::uint32_t>> rows(graph.size());
+    std::atomic<int>                        nextSource{0};
+
+    auto work = [&]() {
+        std::vector<float>        totalCosts(graph.size());
+        std::vector<std::uint8_t> firstMoves(graph.size());
+        for (int source = nextSource++; source < graph.size(); source = nextSource++)
+            buildRow(graph, source, totalCosts, firstMoves, rows[source]);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < workerCount; ++i)
+        pool.emplace_back(work);
+    work();
+    for (auto &thread : pool)
+        thread.join();
+
+    m_offsets.reserve(rows.size() + 1);
+    m_offsets.push_back(0);
+    for (const auto &row : rows)
+        m_offsets.push_back(m_offsets.back() + row.size());
+
+    m_runs.reserve(m_offsets.back());
+    for (auto &row : rows) {
+        m_runs.insert(m_runs.end(), row.begin(), row.end());
+        std::vector<std::uint32_t>().swap(row);
+    }
+}
+
+PathDatabase::PathDatabase(const Graph &graph, const std::string &filePath) : m_graph(graph) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Cannot open " + filePath);
+
+    std::uint32_t header[4];
+    std::uint64_t fingerprint, runCount;
+    read(file, header, 4);
+    read(file, &fingerprint);
+    read(file, &runCount);
+    if (!file || header[0] != magic || header[1] != version)
+        throw std::runtime_error(filePath + " is no path database");
+    if ((int) header[2] != graph.width() || (int) header[3] != graph.height() ||
+        fingerprint != this->fingerprint())
+        throw std::runtime_error(filePath + " belongs to another map");
+
+    m_offsets.resize(graph.size() + 1);
+    m_runs.resize(runCount);
+    read(file, m_offsets.data(), m_offsets.size());
+    read(file, m_runs.data(), m_runs.size());
+    if (!file || m_offsets.back() != runCount)
+        throw std::runtime_error("Reading " + filePath + " failed");
+}
+
+void PathDatabase::save(const std::string &filePath) const {
+    std::ofstream file(filePath, std::ios::binary);
+
+    const std::uint32_t header[4] = {magic, version, (std::uint32_t) m_graph.width(),
+                                     (std::uint32_t) m_graph.height()};
+    const std::uint64_t fingerprint = this->fingerprint();
+    const std::uint64_t runCount = m_runs.size();
+    write(file, header, 4);
+    write(file, &fingerprint);
+    write(file, &runCount);
+    write(file, m_offsets.data(), m_offsets.size());
+    write(file, m_runs.data(), m_runs.size());
+
+    if (!file)
+        throw std::runtime_error("Writing " + filePath + " failed");
+}
+
+// FNV-1a over the costs, to detect tables of a changed map
+std::uint64_t PathDatabase::fingerprint() const {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < m_graph.size(); ++i) {
+        const float   cost = m_graph.cost(i);
+        std::uint32_t bits;
+        std::memcpy(&bits, &cost, sizeof(bits));
+        for (int byte = 0; byte < 4; ++byte)
+            hash = (hash ^ ((bits >> (8 * byte)) & 0xff)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::uint32_t PathDatabase::firstMove(int source, int target) const {
+    const auto begin = m_runs.begin() + m_offsets[source];
+    const auto end = m_runs.begin() + m_offsets[source + 1];
+
+    // The last run starting at or before target, the first one always starts at 0
+    const auto run = std::upper_bound(begin, end, (std::uint32_t) target << 4 | 0xf) - 1;
+    return *run & 0xf;
+}
+
+std::vector<Node> PathDatabase::path(const Position &source, const Position &destination) const {
+    if (source == destination)
+        return {{m_graph, destination}};
+
+    const int width = m_graph.width();
+    const int target = destination.y * width + destination.x;
+    if (firstMove(source.y * width + source.x, target) == noMove)
+        return {};
+
+    std::vector<Node> result = {{m_graph, source}};
+    for (auto position = source; position != destination;) {
+        const auto move = firstMove(position.y * width + position.x, target);
+        position = {position.x + EightMoves::moveX(move), position.y + EightMoves::moveY(move)};
+        result.emplace_back(m_graph, position);
+    }
+    return result;
+}
+
+PathSet PathDatabase::paths(const std::vector<std::pair<Position, Position>> &srcDstList) const {
+    PathSet paths(m_graph.width());
+    paths.reserve(srcDstList.size(), 0);
+    for (const auto &srcDst : srcDstList)
+        paths.push_back(path(srcDst.first, srcDst.second));
+    return paths;
+}
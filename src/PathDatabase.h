@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Graph.h"
+#include "Node.h"
+#include "PathSet.h"
+#include "Position.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compressed path database for small static maps: the first move of an optimal path from every
+// node to every other node, see Botea et al., "Compressed Path Databases". Built by one Dijkstra
+// search per source node on CPU threads. The moves of a source towards all targets, in row-major
+// order of the targets, are stored as runs of equal moves. Paths are then extracted by lookups
+// only. The graph must outlive the database and must not change.
+class PathDatabase {
+public:
+    // Build the tables, threads = 0 uses one per hardware thread.
+    explicit PathDatabase(const Graph &graph, unsigned threads = 0);
+
+    // Load tables saved for this graph. Throws if the file cannot be read or belongs to another
+    // map.
+    PathDatabase(const Graph &graph, const std::string &filePath);
+
+    // File format, all in host byte order: magic, version, width, height (32 bit each), a
+    // fingerprint of the costs and the number of runs (64 bit each), the offsets of the runs of
+    // every node (width * height + 1, 64 bit each) and the runs (32 bit each).
+    void save(const std::string &filePath) const;
+
+    // Optimal path like cpuAStar, empty if there is none.
+    std::vector<Node> path(const Position &source, const Position &destination) const;
+
+    // Batch version of the above, same result type as gpuAStar.
+    PathSet paths(const std::vector<std::pair<Position, Position>> &srcDstList) const;
+
+    std::size_t runs() const { return m_runs.size(); }
+    std::size_t bytes() const {
+        return m_offsets.size() * sizeof(m_offsets[0]) + m_runs.size() * sizeof(m_runs[0]);
+    }
+
+private:
+    static const std::uint32_t magic = 0x4450434f; // "OCPD"
+    static const std::uint32_t version = 1;
+    static const std::uint32_t noMove = 8; // the target itself, or not reachable
+
+    // Run: index of the first target << 4 | move, see moves in PathDatabase.cpp
+    std::uint32_t firstMove(int source, int target) const;
+    std::uint64_t fingerprint() const;
+
+    const Graph &              m_graph;
+    std::vector<std::uint64_t> m_offsets; // runs of node i are [m_offsets[i], m_offsets[i + 1])
+    std::vector<std::uint32_t> m_runs;
+};
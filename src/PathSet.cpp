@@ -0,0 +1,33 @@
+#include "PathSet.h"
+
+#include <iterator>
+
+std::vector<Node> PathSet::Path::nodes(const Graph &graph) const {
+    assert(graph.width() == m_width);
+
+    std::vector<Node> nodes;
+    nodes.reserve(size());
+    for (std::size_t i = 0; i < size(); ++i)
+        nodes.emplace_back(graph, position(i));
+
+    return nodes;
+}
+
+void PathSet::push_back(const std::vector<Node> &path) {
+    assert(path.empty() || path.front().graph().width() == m_width);
+
+    auto *cells = append(path.size(), path.empty() ? NoPath : Found);
+
+    for (const auto &node : path)
+        *cells++ = (Cell)(node.position().y * m_width + node.position().x);
+}
+
+void PathSet::append(const PathSet &other) {
+    assert(other.m_width == m_width);
+
+    const auto base = (std::uint32_t) m_cells.size();
+    m_cells.insert(m_cells.end(), other.m_cells.begin(), other.m_cells.end());
+    for (auto it = std::next(other.m_offsets.begin()); it != other.m_offsets.end(); ++it)
+        m_offsets.push_back(base + *it);
+    m_status.insert(m_status.end(), other.m_status.begin(), other.m_status.end());
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Graph.h"
+#include "Node.h"
+#include "Position.h"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Result of a batch search: all paths packed into one array of cell indices (y * width + x), with
+// offsets to where each path begins and one status code per path.
+class PathSet {
+public:
+    using Cell = std::uint32_t;
+
+    // Same values as the return codes of the gpuAStar kernel
+    enum Status : std::uint8_t { Found = 0, NoPath = 1 };
+
+    // Lightweight view of one path, valid as long as the PathSet is not modified.
+    class Path {
+    public:
+        Path(const Cell *begin, const Cell *end, int width)
+            : m_begin(begin), m_end(end), m_width(width) {}
+
+        const Cell *begin() const { return m_begin; }
+        const Cell *end() const { return m_end; }
+        std::size_t size() const { return m_end - m_begin; }
+        bool        empty() const { return m_begin == m_end; }
+        Cell        operator[](std::size_t index) const { return m_begin[index]; }
+
+        Position position(std::size_t index) const {
+            return {(int) (m_begin[index] % m_width), (int) (m_begin[index] / m_width)};
+        }
+
+        // Expand to nodes, e.g. for Graph::toPfm() or Graph::pathCost()
+        std::vector<Node> nodes(const Graph &graph) const;
+
+    private:
+        const Cell *m_begin;
+        const Cell *m_end;
+        int         m_width;
+    };
+
+    explicit PathSet(int width = 0) : m_width(width) {}
+
+    std::size_t size() const { return m_status.size(); }
+    bool        empty() const { return m_status.empty(); }
+    int         width() const { return m_width; }
+
+    Path operator[](std::size_t index) const {
+        assert(index < size());
+        return {m_cells.data() + m_offsets[index], m_cells.data() + m_offsets[index + 1], m_width};
+    }
+    Status status(std::size_t index) const { return m_status[index]; }
+
+    // Raw storage: offsets has size() + 1 entries, path i is cells[offsets[i], offsets[i + 1]).
+    const std::vector<Cell> &         cells() const { return m_cells; }
+    const std::vector<std::uint32_t> &offsets() const { return m_offsets; }
+
+    void reserve(std::size_t paths, std::size_t cells) {
+        m_cells.reserve(cells);
+        m_offsets.reserve(paths + 1);
+        m_status.reserve(paths);
+    }
+
+    // Add a path of length cells and return where to write them. The pointer is only valid until
+    // the next modification.
+    Cell *append(std::size_t length, Status status) {
+        m_cells.resize(m_cells.size() + length);
+        m_offsets.push_back((std::uint32_t) m_cells.size());
+        m_status.push_back(status);
+        return m_cells.data() + m_cells.size() - length;
+    }
+
+    // Add a path as returned by cpuAStar, empty means no path found.
+    void push_back(const std::vector<Node> &path);
+
+    // Add all paths of other, which must be of a graph with the same width.
+    void append(const PathSet &other);
+
+private:
+    int                        m_width;
+    std::vector<Cell>          m_cells;
+    std::vector<std::uint32_t> m_offsets = {0};
+    std::vector<Status>        m_status;
+};
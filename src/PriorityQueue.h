@@ -6,8 +6,14 @@
 #include <utility>
 #include <vector>
 
-template <typename T, typename Compare = std::less<T>>
+// Heap of Arity children per node. Wider heaps are shallower, so pushing and popping touch fewer
+// scattered cache lines, at the cost of more comparisons per level when popping. Small entries
+// suit them best, the children of a node lie next to each other. The binary heap keeps the order
+// of std::push_heap and std::pop_heap.
+template <typename T, typename Compare = std::less<T>, std::size_t Arity = 2>
 class PriorityQueue {
+    static_assert(Arity >= 2, "a heap needs at least two children per node");
+
 public:
     PriorityQueue(Compare compare = Compare()) : m_compare(std::move(compare)) {}
 
@@ -17,18 +23,29 @@ public:
 
     void push(const T &value) {
         m_heap.push_back(value);
-        std::push_heap(m_heap.begin(), m_heap.end(), m_compare);
+        siftUp(m_heap.size() - 1);
     }
 
     template <typename... Args>
     void emplace(Args &&... args) {
         m_heap.emplace_back(std::forward<Args>(args)...);
-        std::push_heap(m_heap.begin(), m_heap.end(), m_compare);
+        siftUp(m_heap.size() - 1);
     }
 
+    // Empty the heap for reuse, keeping its memory.
+    void clear() { m_heap.clear(); }
+
     void pop() {
-        std::pop_heap(m_heap.begin(), m_heap.end(), m_compare);
+        if (Arity == 2) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), m_compare);
+            m_heap.pop_back();
+            return;
+        }
+
+        T value = std::move(m_heap.back());
         m_heap.pop_back();
+        if (!m_heap.empty())
+            siftDown(std::move(value));
     }
 
     // --- This member functions don't exist in std::priority_queue. ----------
@@ -56,12 +73,63 @@ public:
         // FIXME: assert(???)
 
         m_heap[index] = std::move(newValue);
-        std::push_heap(m_heap.begin(), std::next(m_heap.begin(), index + 1), m_compare);
+        siftUp(index);
 
-        assert(std::is_heap(m_heap.begin(), m_heap.end(), m_compare));
+        assert(isHeap());
     }
 
 private:
+    // Move the value at index up to where its parent comes first.
+    void siftUp(std::size_t index) {
+        if (Arity == 2) {
+            std::push_heap(m_heap.begin(), std::next(m_heap.begin(), index + 1), m_compare);
+            return;
+        }
+
+        T value = std::move(m_heap[index]);
+        while (index > 0) {
+            const auto parent = (index - 1) / Arity;
+            if (!m_compare(m_heap[parent], value))
+                break;
+            m_heap[index] = std::move(m_heap[parent]);
+            index = parent;
+        }
+        m_heap[index] = std::move(value);
+    }
+
+    // Put value at the top and move it down to where it comes before all of its children. Like
+    // std::pop_heap, the hole at the top is moved down to a leaf first and value moved up from
+    // there: taken from the bottom, it mostly belongs down there anyway.
+    void siftDown(T value) {
+        const auto  size = m_heap.size();
+        std::size_t index = 0;
+        while (index * Arity + 1 < size) {
+            // The children lie next to each other. A fixed count of them is unrolled.
+            const auto first = index * Arity + 1;
+            const auto count = std::min(Arity, size - first);
+            auto       child = first;
+            if (count == Arity) {
+                for (std::size_t other = 1; other < Arity; ++other)
+                    child = m_compare(m_heap[child], m_heap[first + other]) ? first + other : child;
+            } else {
+                for (std::size_t other = 1; other < count; ++other)
+                    child = m_compare(m_heap[child], m_heap[first + other]) ? first + other : child;
+            }
+
+            m_heap[index] = std::move(m_heap[child]);
+            index = child;
+        }
+        m_heap[index] = std::move(value);
+        siftUp(index);
+    }
+
+    bool isHeap() {
+        for (std::size_t index = 1; index < m_heap.size(); ++index)
+            if (m_compare(m_heap[(index - 1) / Arity], m_heap[index]))
+                return false;
+        return true;
+    }
+
     std::vector<T> m_heap;
     Compare        m_compare;
 };
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <utility>
+#include <vector>
+
+// Monotone priority queue for A* with a consistent heuristic, where popped priorities never
+// decrease. See Ahuja et al., "Faster Algorithms for the Shortest Path Problem". Values are kept
+// in buckets by the highest bit in which their key differs from the last popped one, so pushing
+// is O(1) and every value is moved to a lower bucket at most 32 times.
+// Keys are the bits of the non-negative float returned by Priority, which compare like the floats
+// themselves, so the order is exact. Ties pop in no particular order, like in PriorityQueue.
+template <typename T, typename Priority>
+class RadixHeap {
+public:
+    RadixHeap(Priority priority = Priority()) : m_priority(std::move(priority)) {}
+
+    // Refills the lowest bucket if needed, hence not const unlike in PriorityQueue.
+    const T &top() {
+        if (m_buckets[0].empty())
+            refill();
+        return m_buckets[0].back().second;
+    }
+    bool        empty() const { return m_size == 0; }
+    std::size_t size() const { return m_size; }
+
+    void push(const T &value) {
+        // Rounding may place a successor a hair below its predecessor. It is popped next then.
+        auto key = this->key(value);
+        if (key < m_last)
+            key = m_last;
+
+        m_buckets[bucket(key)].emplace_back(key, value);
+        ++m_size;
+    }
+
+    template <typename... Args>
+    void emplace(Args &&... args) {
+        push(T(std::forward<Args>(args)...));
+    }
+
+    void pop() {
+        if (m_buckets[0].empty())
+            refill();
+        m_buckets[0].pop_back();
+        --m_size;
+    }
+
+private:
+    using Entry = std::pair<std::uint32_t, T>; // key, value
+
+    std::uint32_t key(const T &value) const {
+        const float priority = m_priority(value);
+        assert(priority >= 0.0f);
+
+        std::uint32_t bits;
+        std::memcpy(&bits, &priority, sizeof(bits));
+        return bits;
+    }
+
+    // 0 for keys equal to the last popped one, otherwise 1 + the highest differing bit
+    std::size_t bucket(std::uint32_t key) const {
+        const auto difference = key ^ m_last;
+        if (difference == 0)
+            return 0;
+#ifdef _MSC_VER
+        unsigned long highest;
+        _BitScanReverse(&highest, difference);
+        return highest + 1;
+#else
+        return 32 - __builtin_clz(difference);
+#endif
+    }
+
+    // Move the smallest keys down into the first bucket.
+    void refill() {
+        assert(m_size > 0);
+
+        std::size_t i = 1;
+        while (m_buckets[i].empty())
+            ++i;
+
+        auto &source = m_buckets[i];
+        m_last = source.front().first;
+        for (const auto &entry : source)
+            if (entry.first < m_last)
+                m_last = entry.first;
+
+        // All keys of the bucket land in lower ones, relative to the new minimum.
+        for (auto &entry : source)
+            m_buckets[bucket(entry.first)].push_back(std::move(entry));
+        source.clear();
+    }
+
+    std::array<std::vector<Entry>, 33> m_buckets;
+    std::uint32_t                      m_last = 0; // key of the last popped value
+    std::size_t                        m_size = 0;
+    Priority                           m_priority;
+};
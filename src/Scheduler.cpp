@@ -0,0 +1,274 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+namespace {
+using Clock = std::chrono::high_resolution_clock;
+
+double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Weight of older observations, so the models follow changing load
+const double decay = 0.9;
+
+// Every this many decisions an engine with few observations is tried even if it is not predicted
+// to be the fastest, as long as it is predicted to be at most explorationSlack times slower.
+const std::size_t explorationInterval = 16;
+const std::size_t explorationSamples = 3;
+const double      explorationSlack = 10.0;
+} // namespace
+
+void Scheduler::LatencyModel::observe(double work, double seconds) {
+    m_n = decay * m_n + 1.0;
+    m_x = decay * m_x + work;
+    m_y = decay * m_y + seconds;
+    m_xx = decay * m_xx + work * work;
+    m_xy = decay * m_xy + work * seconds;
+    ++m_samples;
+
+    // Least squares fit if the observed work differs enough, otherwise only refit the slope.
+    const double det = m_n * m_xx - m_x * m_x;
+    if (m_samples >= 2 && det > 1e-6 * m_n * m_xx) {
+        m_perUnit = (m_n * m_xy - m_x * m_y) / det;
+        m_setup = (m_y - m_perUnit * m_x) / m_n;
+    } else if (m_x > 0.0) {
+        m_perUnit = (m_y - m_n * m_setup) / m_x;
+    } else {
+        m_setup = m_y / m_n;
+    }
+
+    // Noise must not produce negative latencies
+    if (m_perUnit < 0.0) {
+        m_perUnit = 0.0;
+        m_setup = m_y / m_n;
+    }
+    if (m_setup < 0.0) {
+        m_setup = 0.0;
+        m_perUnit = m_xx > 0.0 ? m_xy / m_xx : 0.0;
+    }
+}
+
+// Initial guesses: building the OpenCL program and uploading the graph dominate the GPU engines
+// until the first observations come in.
+Scheduler::Scheduler(const Graph &graph, const boost::compute::device &gaDevice,
+                     std::vector<boost::compute::device> batchDevices, unsigned threads)
+    : m_graph(graph), m_gaDevice(gaDevice), m_batchDevices(std::move(batchDevices)),
+      m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      m_models{{0.0, 5e-7}, {0.2, 1e-8}, {0.2, 1e-8}} {
+    float minCost = graph.cost(0);
+    for (int i = 1; i < graph.size(); ++i)
+        minCost = std::min(minCost, graph.cost(i));
+
+    // Count cells above the cheapest cost as obstacles
+    const int stride = graph.width() + 1;
+    m_obstacles.resize(stride * (graph.height() + 1), 0);
+    for (int y = 0; y < graph.height(); ++y) {
+        for (int x = 0; x < graph.width(); ++x) {
+            const int obstacle = graph.cost(y * graph.width() + x) > minCost ? 1 : 0;
+            m_obstacles[(y + 1) * stride + x + 1] = obstacle + m_obstacles[y * stride + x + 1] +
+                                                    m_obstacles[(y + 1) * stride + x] -
+                                                    m_obstacles[y * stride + x];
+        }
+    }
+}
+
+double Scheduler::difficulty(const Position &source, const Position &destination) const {
+    const int dx = std::abs(destination.x - source.x);
+    const int dy = std::abs(destination.y - source.y);
+
+#ifdef GRAPH_DIAGONAL_MOVEMENT
+    const double distance = std::max(dx, dy) + (std::sqrt(2.0) - 1.0) * std::min(dx, dy);
+#else
+    const double distance = dx + dy;
+#endif
+
+    // Obstacle density of the bounding box
+    const int stride = m_graph.width() + 1;
+    const int x0 = std::min(source.x, destination.x), x1 = std::max(source.x, destination.x) + 1;
+    const int y0 = std::min(source.y, destination.y), y1 = std::max(source.y, destination.y) + 1;
+    const int obstacles = m_obstacles[y1 * stride + x1] - m_obstacles[y0 * stride + x1] -
+                          m_obstacles[y1 * stride + x0] + m_obstacles[y0 * stride + x0];
+    const double density = (double) obstacles / ((x1 - x0) * (y1 - y0));
+
+    return distance * distance * (1.0 + density);
+}
+
+bool Scheduler::available(Engine engine) const {
+    return !m_failed[engine] && (engine != Batch || !m_batchDevices.empty());
+}
+
+// Pick cpuAStar or gpuGAStar for a single query. Needs m_mutex.
+Scheduler::Engine Scheduler::route(double work) {
+    ++m_decisions;
+
+    if (!available(GAStar))
+        return Cpu;
+
+    const auto cpu = m_models[Cpu].predict(work);
+    const auto gaStar = m_models[GAStar].predict(work);
+    const auto best = gaStar < cpu ? GAStar : Cpu;
+    const auto other = best == Cpu ? GAStar : Cpu;
+
+    if (m_decisions % explorationInterval == 0 && m_models[other].samples() < explorationSamples &&
+        m_models[other].predict(work) <= explorationSlack * m_models[best].predict(work))
+        return other;
+
+    return best;
+}
+
+void Scheduler::observe(Engine engine, double work, double seconds) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_models[engine].observe(work, seconds);
+}
+
+std::vector<Node> Scheduler::findPath(const Position &source, const Position &destination) {
+    const auto work = difficulty(source, destination);
+
+    Engine engine;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        engine = route(work);
+        ++m_queries[engine];
+    }
+
+    const auto start = Clock::now();
+    if (engine == GAStar) {
+        try {
+            auto path = gpuGAStar(m_graph, source, destination, m_gaDevice);
+            if (!path.empty()) // queries without a path would pass for cheap wins
+                observe(GAStar, work, seconds(start));
+            return path;
+        } catch (std::exception &e) {
+            std::cerr << "Scheduler: GA* disabled:\n" << e.what() << std::endl;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_failed[GAStar] = true;
+        }
+    }
+
+    const auto cpuStart = Clock::now();
+    auto       path = cpuAStar(m_graph, source, destination);
+    if (!path.empty())
+        observe(Cpu, work, seconds(cpuStart));
+    return path;
+}
+
+PathSet Scheduler::findPaths(const std::vector<std::pair<Position, Position>> &srcDstList) {
+    const auto count = srcDstList.size();
+
+    std::vector<double> works(count);
+    for (std::size_t i = 0; i < count; ++i)
+        works[i] = difficulty(srcDstList[i].first, srcDstList[i].second);
+    const auto totalWork = std::accumulate(works.begin(), works.end(), 0.0);
+
+    // Whole batch on the multi-agent kernel, if it beats the CPU workers
+    bool batch = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (available(Batch) && count > 1) {
+            ++m_decisions;
+
+            double cpu = 0.0;
+            for (const auto work : works)
+                cpu += m_models[Cpu].predict(work);
+            cpu /= std::min<std::size_t>(m_threads, count);
+            const auto gpu = m_models[Batch].predict(totalWork);
+
+            batch = gpu < cpu || (m_decisions % explorationInterval == 0 &&
+                                  m_models[Batch].samples() < explorationSamples &&
+                                  gpu <= explorationSlack * cpu);
+        }
+    }
+
+    if (batch) {
+        try {
+            const auto start = Clock::now();
+            auto       paths = gpuAStar(m_graph, srcDstList, m_batchDevices);
+            observe(Batch, totalWork, seconds(start));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queries[Batch] += count;
+            return paths;
+        } catch (std::exception &e) {
+            std::cerr << "Scheduler: Multi-agent A* disabled:\n" << e.what() << std::endl;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_failed[Batch] = true;
+        }
+    }
+
+    // Otherwise route every query on its own
+    std::vector<std::size_t> cpuQueries, gaStarQueries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (std::size_t i = 0; i < count; ++i)
+            (route(works[i]) == GAStar ? gaStarQueries : cpuQueries).push_back(i);
+        m_queries[Cpu] += cpuQueries.size();
+        m_queries[GAStar] += gaStarQueries.size();
+    }
+
+    std::vector<std::vector<Node>> paths(count);
+    std::vector<double>            latencies(count);
+
+    // CPU queries on the workers, pulling the next query when done with the last one
+    std::atomic<std::size_t> next{0};
+    auto                     worker = [&]() {
+        for (auto i = next++; i < cpuQueries.size(); i = next++) {
+            const auto  query = cpuQueries[i];
+            const auto &srcDst = srcDstList[query];
+            const auto  start = Clock::now();
+            paths[query] = cpuAStar(m_graph, srcDst.first, srcDst.second);
+            latencies[query] = seconds(start);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const auto workerCount = std::min<std::size_t>(m_threads, cpuQueries.size());
+    for (std::size_t i = 0; i < workerCount; ++i)
+        workers.emplace_back(worker);
+
+    // GA* queries one after another on this thread meanwhile. They already use the whole device.
+    for (const auto query : gaStarQueries) {
+        const auto &srcDst = srcDstList[query];
+        const auto  start = Clock::now();
+        try {
+            paths[query] = gpuGAStar(m_graph, srcDst.first, srcDst.second, m_gaDevice);
+            if (!paths[query].empty())
+                observe(GAStar, works[query], seconds(start));
+            continue;
+        } catch (std::exception &e) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_failed[GAStar])
+                std::cerr << "Scheduler: GA* disabled:\n" << e.what() << std::endl;
+            m_failed[GAStar] = true;
+        }
+
+        const auto cpuStart = Clock::now();
+        paths[query] = cpuAStar(m_graph, srcDst.first, srcDst.second);
+        if (!paths[query].empty())
+            observe(Cpu, works[query], seconds(cpuStart));
+    }
+
+    for (auto &thread : workers)
+        thread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto query : cpuQueries)
+            if (!paths[query].empty())
+                m_models[Cpu].observe(works[query], latencies[query]);
+    }
+
+    PathSet result(m_graph.width());
+    for (const auto &path : paths)
+        result.push_back(path);
+
+    return result;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "astar.h"
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Routes queries to the engine that is expected to answer them fastest: cpuAStar on a few worker
+// threads, gpuGAStar for single long queries or gpuAStar for large batches. The expected latency of
+// each engine is a linear model over the estimated query difficulty, which is refitted from the
+// observed latencies after every run that found a path. GPU engines that fail (e.g. no OpenCL
+// device) are disabled.
+class Scheduler {
+public:
+    enum Engine { Cpu, GAStar, Batch, EngineCount };
+
+    // Latency = setup + perUnit * work, fitted by exponentially decaying least squares.
+    class LatencyModel {
+    public:
+        LatencyModel(double setup, double perUnit) : m_setup(setup), m_perUnit(perUnit) {}
+
+        void        observe(double work, double seconds);
+        double      predict(double work) const { return m_setup + m_perUnit * work; }
+        std::size_t samples() const { return m_samples; }
+
+    private:
+        double      m_setup;
+        double      m_perUnit;
+        double      m_n = 0.0, m_x = 0.0, m_y = 0.0, m_xx = 0.0, m_xy = 0.0; // decayed sums
+        std::size_t m_samples = 0;
+    };
+
+    // The obstacle index is built from the graph costs at construction.
+    Scheduler(const Graph &graph,
+              const boost::compute::device &gaDevice = boost::compute::system::default_device(),
+              std::vector<boost::compute::device> batchDevices = boost::compute::system::devices(),
+              unsigned threads = 0); // 0: one per hardware thread
+
+    std::vector<Node> findPath(const Position &source, const Position &destination);
+
+    PathSet findPaths(const std::vector<std::pair<Position, Position>> &srcDstList);
+
+    // Estimated work of a query: squared octile distance scaled by the obstacle density of the
+    // bounding box, roughly proportional to the number of nodes A* expands.
+    double difficulty(const Position &source, const Position &destination) const;
+
+    const LatencyModel &model(Engine engine) const { return m_models[engine]; }
+    std::size_t         queries(Engine engine) const { return m_queries[engine]; }
+
+private:
+    Engine route(double work);
+    void   observe(Engine engine, double work, double seconds);
+    bool   available(Engine engine) const;
+
+    const Graph &                       m_graph;
+    boost::compute::device              m_gaDevice;
+    std::vector<boost::compute::device> m_batchDevices;
+    unsigned                            m_threads;
+
+    // Summed area table of cells with more than the base cost, (width + 1) * (height + 1) entries
+    std::vector<int> m_obstacles;
+
+    mutable std::mutex m_mutex; // guards models, counters and flags below
+    LatencyModel       m_models[EngineCount];
+    std::size_t        m_queries[EngineCount] = {};
+    bool               m_failed[EngineCount] = {};
+    std::size_t        m_decisions = 0;
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include "Connectivity.h"
+#include "Graph.h"
+#include "Node.h"
+#include "Position.h"
+#include "PriorityQueue.h"
+#include "RadixHeap.h"
+#include "SearchStats.h"
+#include "astar.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+// Best-first search loop of the CPU engines, a template on
+//  - Connectivity: the moves of the grid and the distance estimate that fits them,
+//    EightConnected<expand> or FourConnected
+//  - Costs: how the cell costs are read, FloatCosts or QuantizedCosts<level>
+//  - Heuristic: the targets and the estimate to the nearest of them, SingleTarget or
+//    NearestTarget, instantiated on the connectivity
+//  - Queue: the open list of SearchEntry, see OpenQueue
+// The statistics sink, CpuSearchStats or NoSearchStats, is a template argument of every search.
+// Every combination is a loop of its own, with all policies inlined and no branches on them.
+// dispatchSearch() picks the instantiation at runtime, so adding a variant does not slow down the
+// others.
+
+// 8 bytes, so the children of a node in a wide heap share few cache lines
+struct SearchEntry {
+    SearchEntry(int _node, float _priority) : node(_node), priority(_priority) {}
+
+    int   node;     // index into the graph
+    float priority; // g + h
+
+    // Comparator to put cheapest nodes first.
+    struct Compare {
+        bool operator()(const SearchEntry &a, const SearchEntry &b) {
+            return a.priority > b.priority;
+        }
+    };
+
+    // Key of the radix heap
+    struct Priority {
+        float operator()(const SearchEntry &entry) const { return entry.priority; }
+    };
+};
+
+template <OpenList>
+struct OpenQueueOf;
+template <>
+struct OpenQueueOf<OpenList::BinaryHeap> {
+    using type = PriorityQueue<SearchEntry, SearchEntry::Compare, 2>;
+};
+template <>
+struct OpenQueueOf<OpenList::FourAryHeap> {
+    using type = PriorityQueue<SearchEntry, SearchEntry::Compare, 4>;
+};
+template <>
+struct OpenQueueOf<OpenList::EightAryHeap> {
+    using type = PriorityQueue<SearchEntry, SearchEntry::Compare, 8>;
+};
+template <>
+struct OpenQueueOf<OpenList::RadixHeap> {
+    using type = RadixHeap<SearchEntry, SearchEntry::Priority>;
+};
+
+template <OpenList openList>
+using OpenQueue = typename OpenQueueOf<openList>::type;
+
+// One target. The estimate of the expansion is the heuristic already.
+template <typename Connectivity>
+class SingleTarget {
+public:
+    void bind(const Graph &graph) { m_width = graph.width(); }
+
+    void setTargets(const std::vector<int> &targets) {
+        assert(targets.size() == 1);
+        m_node = targets[0];
+        m_position = {m_node % m_width, m_node / m_width};
+    }
+    void clearTargets() {}
+
+    // The target the expansion estimates the distance to
+    const Position &primary() const { return m_position; }
+
+    bool  isTarget(int node) const { return node == m_node; }
+    float operator()(const Position &position) const {
+        return Connectivity::distance(position, m_position);
+    }
+    float refine(int, float estimate) const { return estimate; }
+
+private:
+    int      m_width = 0;
+    int      m_node = -1;
+    Position m_position = {0, 0};
+};
+
+// Several targets: the minimum of the distances to them, which is consistent like each of them.
+// Costs a loop over the other targets per relaxation.
+template <typename Connectivity>
+class NearestTarget {
+public:
+    // The flags are all clear between searches.
+    void bind(const Graph &graph) {
+        m_width = graph.width();
+        m_flags.resize(graph.size(), 0);
+    }
+
+    void setTargets(const std::vector<int> &targets) {
+        assert(!targets.empty());
+        m_nodes = targets;
+        m_positions.clear();
+        for (const auto target : targets) {
+            m_flags[target] = 1;
+            m_positions.push_back({target % m_width, target / m_width});
+        }
+    }
+    void clearTargets() {
+        for (const auto target : m_nodes)
+            m_flags[target] = 0;
+        m_nodes.clear();
+    }
+
+    const Position &primary() const { return m_positions[0]; }
+
+    bool  isTarget(int node) const { return m_flags[node] != 0; }
+    float operator()(const Position &position) const {
+        return refine(position, Connectivity::distance(position, m_positions[0]));
+    }
+    // estimate: distance of node to the primary target
+    float refine(int node, float estimate) const {
+        return m_positions.size() > 1 ? refine({node % m_width, node / m_width}, estimate)
+                                      : estimate;
+    }
+
+private:
+    float refine(const Position &position, float estimate) const {
+        for (std::size_t i = 1; i < m_positions.size(); ++i)
+            estimate = std::min(estimate, Connectivity::distance(position, m_positions[i]));
+        return estimate;
+    }
+
+    int                       m_width = 0;
+    std::vector<std::uint8_t> m_flags; // set for the current targets only
+    std::vector<int>          m_nodes;
+    std::vector<Position>     m_positions;
+};
+
+// Implementation like in https://de.wikipedia.org/wiki/A*-Algorithmus#Funktionsweise, but nodes
+// are queued again instead of updated in the open list, outdated entries are skipped. The per
+// node state is kept over all searches, only the touched nodes are reset, so a query costs only
+// the nodes it reaches.
+template <typename Connectivity, typename Costs, template <typename> class Heuristic,
+          typename Queue>
+class SearchCore {
+public:
+    // Search graph from now on. The per node state is reallocated only if its size changes.
+    void bind(const Graph &graph) {
+        reset();
+        m_graph = &graph;
+        m_heuristic.bind(graph);
+        if (m_totalCosts.size() != (std::size_t) graph.size()) {
+            m_totalCosts.assign(graph.size(), std::numeric_limits<float>::infinity());
+            m_predecessors.assign(graph.size(), -1);
+            m_closed.assign(graph.size(), 0);
+        }
+    }
+
+    // From all starts to the first target taken from the open list. Returns the path from that
+    // target back to its start, empty if there is none.
+    template <typename Stats>
+    std::vector<Node> search(const std::vector<int> &starts, const std::vector<int> &targets,
+                             Stats &stats) {
+        stats.beginSearch();
+        reset();
+        m_heuristic.setTargets(targets);
+
+        const Graph &graph = *m_graph;
+        const Costs  costs(graph);
+        const int    width = graph.width(), height = graph.height();
+        auto      position = [width](int node) { return Position{node % width, node / width}; };
+
+        // Begin at all starts
+        Queue open;
+        for (const auto start : starts) {
+            m_totalCosts[start] = 0.0f;
+            m_predecessors[start] = start;
+            m_touched.push_back(start);
+            open.emplace(start, m_heuristic(position(start)));
+        }
+
+        std::vector<Node> result;
+        while (!open.empty()) {
+            stats.openSize(open.size());
+            const auto current = open.top();
+            open.pop();
+
+            // The heuristic of a node is fixed, so of its entries the one queued with the
+            // cheapest cost comes first. Any later one is outdated.
+            if (m_closed[current.node])
+                continue;
+
+            // Reached a target, restore path.
+            if (m_heuristic.isTarget(current.node)) {
+                stats.foundPath();
+                for (int node = current.node;; node = m_predecessors[node]) {
+                    result.emplace_back(graph, position(node));
+                    if (m_predecessors[node] == node)
+                        break;
+                }
+                break;
+            }
+
+            m_closed[current.node] = 1;
+            stats.expanded(current.node);
+
+            Connectivity::expand(
+                costs, width, height, current.node, m_totalCosts[current.node],
+                m_heuristic.primary(), [&](int nbNode, float nbTotalCost, float nbEstimate) {
+                    // Already visited (cycle), or other path cost is equal or better
+                    if (m_closed[nbNode] || m_totalCosts[nbNode] <= nbTotalCost)
+                        return;
+
+                    stats.relaxed();
+
+                    if (m_totalCosts[nbNode] == std::numeric_limits<float>::infinity())
+                        m_touched.push_back(nbNode);
+                    m_totalCosts[nbNode] = nbTotalCost;
+                    m_predecessors[nbNode] = current.node;
+                    open.emplace(nbNode, nbTotalCost + m_heuristic.refine(nbNode, nbEstimate));
+                });
+        }
+
+        m_heuristic.clearTargets();
+        stats.endSearch();
+        return result;
+    }
+
+private:
+    void reset() {
+        for (const auto node : m_touched) {
+            m_totalCosts[node] = std::numeric_limits<float>::infinity();
+            m_closed[node] = 0;
+        }
+        m_touched.clear();
+    }
+
+    const Graph *             m_graph = nullptr;
+    Heuristic<Connectivity>   m_heuristic;
+    std::vector<float>        m_totalCosts;
+    std::vector<int>          m_predecessors;
+    std::vector<std::uint8_t> m_closed;
+    std::vector<int>          m_touched;
+};
+
+template <typename T>
+struct TypeTag {
+    using type = T;
+};
+
+// Calls function(TypeTag<Costs>()) with the cost storage of graph, and returns its result.
+template <typename Function>
+auto dispatchCosts(const Graph &graph, Function &&function) {
+    switch (graph.costBits()) {
+    case 8: return function(TypeTag<QuantizedCosts<std::uint8_t>>());
+    case 16: return function(TypeTag<QuantizedCosts<std::uint16_t>>());
+    default: return function(TypeTag<FloatCosts>());
+    }
+}
+
+// Calls function(TypeTag<Connectivity>()) with the moves of Graph, on the fastest expansion for
+// this CPU, and returns its result.
+template <typename Function>
+auto dispatchConnectivity(Function &&function) {
+#ifdef GRAPH_DIAGONAL_MOVEMENT
+    static const bool avx2 = hasAvx2(), sse = hasSse();
+    if (avx2)
+        return function(TypeTag<EightConnected<expandAvx2>>());
+    if (sse)
+        return function(TypeTag<EightConnected<expandSse>>());
+    return function(TypeTag<EightConnected<expandScalar>>());
+#else
+    return function(TypeTag<FourConnected>());
+#endif
+}
+
+// Calls function(core, stats) with a SearchCore bound to graph, for openList and stats, and
+// returns its result. Statistics only cost time if requested. Every thread keeps one core per
+// instantiation, so single queries reuse its per node state instead of allocating their own.
+template <template <typename> class Heuristic, typename Function>
+auto dispatchSearch(const Graph &graph, OpenList openList, CpuSearchStats *stats,
+                    Function &&function) {
+    return dispatchConnectivity([&](auto connectivity) {
+        return dispatchCosts(graph, [&](auto costs) {
+            using Connectivity = typename decltype(connectivity)::type;
+            using Costs = typename decltype(costs)::type;
+
+            auto withQueue = [&](auto queue) {
+                using Queue = typename decltype(queue)::type;
+                thread_local SearchCore<Connectivity, Costs, Heuristic, Queue> core;
+                core.bind(graph);
+                if (stats)
+                    return function(core, *stats);
+
+                NoSearchStats noStats;
+                return function(core, noStats);
+            };
+
+            switch (openList) {
+            case OpenList::BinaryHeap:
+                return withQueue(TypeTag<OpenQueue<OpenList::BinaryHeap>>());
+            case OpenList::FourAryHeap:
+                return withQueue(TypeTag<OpenQueue<OpenList::FourAryHeap>>());
+            case OpenList::EightAryHeap:
+                return withQueue(TypeTag<OpenQueue<OpenList::EightAryHeap>>());
+            default: return withQueue(TypeTag<OpenQueue<OpenList::RadixHeap>>());
+            }
+        });
+    });
+}
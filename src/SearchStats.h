@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Heatmap.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#pragma warning(push)
+// Disable warning for VS 2017
+#pragma warning(disable : 4244) // conversion from 'boost::compute::ulong_' to '::size_t' [...]
+#include <boost/compute/event.hpp>
+#pragma warning(pop)
+
+// Profiling info of one finished kernel launch. Timestamps are taken from the device timer in
+// nanoseconds, so only differences between them are meaningful.
+struct KernelEvent {
+    KernelEvent(std::string _name, const boost::compute::event &event)
+        : name(std::move(_name)),
+          queued(event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_QUEUED)),
+          submit(event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_SUBMIT)),
+          start(event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_START)),
+          end(event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_END)) {}
+
+    std::string name;
+    cl_ulong    queued;
+    cl_ulong    submit;
+    cl_ulong    start;
+    cl_ulong    end;
+};
+
+// Statistics of the OpenCL searches. Passing one of these enables queue profiling and compiles the
+// device side counters into the kernels, both of which cost a little performance. Values
+// accumulate if the same object is passed to several searches.
+struct GpuSearchStats {
+    GpuSearchStats &operator+=(const GpuSearchStats &other) {
+        uploadTime += other.uploadTime;
+        downloadTime += other.downloadTime;
+        kernels.insert(kernels.end(), other.kernels.begin(), other.kernels.end());
+        expanded += other.expanded;
+        pushes += other.pushes;
+        pops += other.pops;
+        spills += other.spills;
+        agents += other.agents;
+        return *this;
+    }
+
+    // Measured on the host
+    std::chrono::duration<double> uploadTime{0};
+    std::chrono::duration<double> downloadTime{0};
+
+    // One entry per kernel launch, in launch order
+    std::vector<KernelEvent> kernels;
+
+    // Device side counters, summed over all agents (gpuAStar) or queues (gpuGAStar)
+    std::uint64_t expanded = 0; // nodes taken from an open list and expanded
+    std::uint64_t pushes = 0;   // open list insertions (not counting decrease-key updates)
+    std::uint64_t pops = 0;     // open list removals
+    std::uint64_t spills = 0;   // gpuAStar only: pushes beyond openLocal into openGlobalExt
+    std::uint64_t agents = 0;   // gpuAStar only: queries searched, without duplicates and hits
+
+    // Expansions per cell, counted atomically on the device, and the frontier after every
+    // iteration of gpuGAStar. Only filled if set, and not summed up by +=.
+    Heatmap *heatmap = nullptr;
+};
+
+// Statistics sink of cpuAStar. The search is a template on its sink, so the calls below compile
+// to nothing with NoSearchStats. CpuSearchStats only increments counters and reads the clock
+// three times per search, which is cheap enough to leave enabled.
+struct NoSearchStats {
+    void beginSearch() {}
+    void expanded(std::int64_t) {}
+    void relaxed() {}
+    void openSize(std::size_t) {}
+    void foundPath() {}
+    void endSearch() {}
+};
+
+struct CpuSearchStats {
+    using Clock = std::chrono::steady_clock;
+
+    void beginSearch() {
+        ++searches;
+        m_phaseStart = Clock::now();
+    }
+    void expanded(std::int64_t node) {
+        ++expansions;
+        if (heatmap)
+            heatmap->expanded(node);
+    }
+    void relaxed() { ++relaxations; }
+    void openSize(std::size_t size) {
+        if (size > openHighWater)
+            openHighWater = size;
+    }
+    void foundPath() {
+        const auto now = Clock::now();
+        searchTime += now - m_phaseStart;
+        m_phaseStart = now;
+        m_reconstructing = true;
+    }
+    void endSearch() {
+        const auto now = Clock::now();
+        (m_reconstructing ? reconstructTime : searchTime) += now - m_phaseStart;
+        m_reconstructing = false;
+    }
+
+    std::uint64_t searches = 0;
+    std::uint64_t expansions = 0;    // nodes taken from the open list and expanded
+    std::uint64_t relaxations = 0;   // open list insertions and decrease-key updates
+    std::size_t   openHighWater = 0; // largest open list size over all searches
+
+    // Time spent in the main loop and in restoring the path from the closed list
+    std::chrono::duration<double> searchTime{0};
+    std::chrono::duration<double> reconstructTime{0};
+
+    // Expansions per cell, only filled if set
+    Heatmap *heatmap = nullptr;
+
+  private:
+    Clock::time_point m_phaseStart;
+    bool              m_reconstructing = false;
+};
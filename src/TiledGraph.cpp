@@ -0,0 +1,117 @@
+#include "TiledGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+TiledGraph::TiledGraph(int width, int height, Loader loader, int tileSize,
+                       std::size_t maxResidentTiles)
+    : m_width(width), m_height(height), m_loader(std::move(loader)), m_tileSize(tileSize),
+      m_maxResidentTiles(std::max<std::size_t>(1, maxResidentTiles)) {
+    assert(width > 0 && height > 0 && tileSize > 0);
+}
+
+TiledGraph::Loader TiledGraph::graphLoader(const Graph &graph) {
+    return [&graph](int x, int y, int width, int height, float *costs) {
+        for (int row = y; row < y + height; ++row)
+            for (int column = x; column < x + width; ++column)
+                *costs++ = graph.cost(row * graph.width() + column);
+    };
+}
+
+TiledGraph::Loader TiledGraph::rawFileLoader(const std::string &filePath, int width) {
+    // Shared, so copies of the loader keep reading from the same stream
+    auto file = std::make_shared<std::ifstream>(filePath, std::ios::binary);
+    if (!*file)
+        throw std::runtime_error("Cannot open " + filePath);
+
+    return [file, width](int x, int y, int tileWidth, int tileHeight, float *costs) {
+        for (int row = y; row < y + tileHeight; ++row, costs += tileWidth) {
+            file->seekg(((std::int64_t) row * width + x) * sizeof(float));
+            file->read(reinterpret_cast<char *>(costs), tileWidth * sizeof(float));
+        }
+        if (!*file)
+            throw std::runtime_error("Reading tile failed");
+    };
+}
+
+void TiledGraph::touch(int tileX, int tileY) {
+    assert(tileX >= 0 && tileY >= 0 && tileX * m_tileSize < m_width &&
+           tileY * m_tileSize < m_height);
+
+    const auto tilesPerRow = (m_width + m_tileSize - 1) / m_tileSize;
+    const auto key = (std::int64_t) tileY * tilesPerRow + tileX;
+
+    auto it = m_tiles.find(key);
+    if (it != m_tiles.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    } else {
+        if (m_tiles.size() >= m_maxResidentTiles) {
+            m_tiles.erase(m_lru.back());
+            m_lru.pop_back();
+            ++m_evictions;
+        }
+
+        const int x = tileX * m_tileSize, y = tileY * m_tileSize;
+        const int width = std::min(m_tileSize, m_width - x);
+        const int height = std::min(m_tileSize, m_height - y);
+
+        Tile tile;
+        tile.width = width;
+        tile.costs.resize((std::size_t) width * height);
+        m_loader(x, y, width, height, tile.costs.data());
+        ++m_loads;
+
+        m_lru.push_front(key);
+        tile.lru = m_lru.begin();
+        it = m_tiles.emplace(key, std::move(tile)).first;
+    }
+
+    m_lastX = tileX;
+    m_lastY = tileY;
+    m_last = &it->second;
+}
+
+float TiledGraph::pathCost(const Position &source, const Position &destination) {
+    assert(inBounds(source));
+    assert(inBounds(destination));
+
+// This function is only legal for neighbors!
+#ifndef GRAPH_DIAGONAL_MOVEMENT
+    assert((std::abs(source.x - destination.x) == 1 && source.y == destination.y) ||
+           (std::abs(source.y - destination.y) == 1 && source.x == destination.x));
+
+    return std::max(cost(source), cost(destination));
+#else
+    assert(std::abs(source.x - destination.x) <= 1 && std::abs(source.y - destination.y) <= 1);
+
+    const bool diagonal = source.x != destination.x && source.y != destination.y;
+    const auto stepCost = std::max(cost(source), cost(destination));
+    constexpr float sqrt2 = 1.41421356237f;
+    return diagonal ? sqrt2 * stepCost : stepCost;
+#endif
+}
+
+Graph TiledGraph::window(int x, int y, int width, int height) {
+    assert(x >= 0 && y >= 0 && x + width <= m_width && y + height <= m_height);
+
+    // Tile by tile, so every tile is loaded once even if it does not stay resident
+    std::vector<float> costs((std::size_t) width * height);
+    for (int tileY = y / m_tileSize; tileY * m_tileSize < y + height; ++tileY) {
+        for (int tileX = x / m_tileSize; tileX * m_tileSize < x + width; ++tileX) {
+            const int x0 = std::max(x, tileX * m_tileSize);
+            const int x1 = std::min(x + width, (tileX + 1) * m_tileSize);
+            const int y0 = std::max(y, tileY * m_tileSize);
+            const int y1 = std::min(y + height, (tileY + 1) * m_tileSize);
+
+            for (int row = y0; row < y1; ++row)
+                for (int column = x0; column < x1; ++column)
+                    costs[(std::size_t)(row - y) * width + column - x] = cost(column, row);
+        }
+    }
+
+    return Graph(width, height, std::move(costs));
+}
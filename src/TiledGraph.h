@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Graph.h"
+#include "Position.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Grid graph split into fixed-size square tiles, for maps that do not fit into memory or a single
+// device allocation. Tiles are loaded on demand through a loader and the least recently used ones
+// are evicted, so at most maxResidentTiles tiles of costs are held at a time. Cells are addressed
+// by global positions, within a tile by local indices y * tileWidth + x.
+// Not thread-safe: even reading costs may load and evict tiles.
+class TiledGraph {
+public:
+    // Fills the costs of the width * height cells starting at x, y, row by row.
+    using Loader = std::function<void(int x, int y, int width, int height, float *costs)>;
+
+    TiledGraph(int width, int height, Loader loader, int tileSize = 256,
+               std::size_t maxResidentTiles = 64);
+
+    // Tiles copied from an in-memory graph, mostly for validation against the untiled engines
+    static Loader graphLoader(const Graph &graph);
+    // Tiles read from a file of width * height 32 bit floats, row by row
+    static Loader rawFileLoader(const std::string &filePath, int width);
+
+    float cost(int x, int y) {
+        const auto tileX = x / m_tileSize, tileY = y / m_tileSize;
+        if (tileX != m_lastX || tileY != m_lastY)
+            touch(tileX, tileY);
+        return m_last->costs[(y - tileY * m_tileSize) * m_last->width + x - tileX * m_tileSize];
+    }
+    float cost(const Position &position) { return cost(position.x, position.y); }
+
+    // Same as Graph::pathCost(), only legal for neighbors
+    float pathCost(const Position &source, const Position &destination);
+
+    // Copy of a rectangle of cells as a graph with local coordinates, e.g. for the OpenCL engines
+    Graph window(int x, int y, int width, int height);
+
+    bool inBounds(const Position &p) const {
+        return p.x >= 0 && p.y >= 0 && p.x < m_width && p.y < m_height;
+    }
+
+    int           width() const { return m_width; }
+    int           height() const { return m_height; }
+    std::int64_t  size() const { return (std::int64_t) m_width * m_height; }
+    int           tileSize() const { return m_tileSize; }
+    std::size_t   maxResidentTiles() const { return m_maxResidentTiles; }
+    std::size_t   residentTiles() const { return m_tiles.size(); }
+    std::uint64_t loads() const { return m_loads; }
+    std::uint64_t evictions() const { return m_evictions; }
+
+private:
+    struct Tile {
+        int                              width; // smaller than the tile size at the map border
+        std::vector<float>               costs;
+        std::list<std::int64_t>::iterator lru;
+    };
+
+    void touch(int tileX, int tileY);
+
+    int         m_width;
+    int         m_height;
+    Loader      m_loader;
+    int         m_tileSize;
+    std::size_t m_maxResidentTiles;
+
+    std::unordered_map<std::int64_t, Tile> m_tiles; // by tileY * tiles per row + tileX
+    std::list<std::int64_t>                m_lru;   // most recently used first
+
+    // Tile of the last access, it is at the front of m_lru and never evicted first
+    int   m_lastX = -1;
+    int   m_lastY = -1;
+    Tile *m_last = nullptr;
+
+    std::uint64_t m_loads = 0;
+    std::uint64_t m_evictions = 0;
+};
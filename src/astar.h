@@ -10,9 +10,21 @@
 
 #define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
 
+// Boost.Compute keeps its program caches in globals. Make them thread local, gpuAStar runs one
+// thread per device when given several.
+#define BOOST_COMPUTE_THREAD_SAFE
+#define BOOST_COMPUTE_HAVE_THREAD_LOCAL
+
 #include "Graph.h"
 #include "Node.h"
+#include "PathCache.h"
+#include "PathSet.h"
 #include "Position.h"
+#include "SearchStats.h"
+#include "TiledGraph.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <vector>
 
 #pragma warning(push)
@@ -25,12 +37,126 @@
 // Enable printing of debug information from functions below.
 //#define DEBUG_OUTPUT
 
-std::vector<Node> cpuAStar(const Graph &graph, const Position &source, const Position &destination);
+// A path together with a proven bound on its suboptimality: its cost is at most bound times the
+// cost of an optimal path.
+struct BoundedPath {
+    std::vector<Node> path;
+    float             bound = 1.0f;
+};
+
+// Open list of cpuAStar. The radix heap relies on the priorities of popped nodes never decreasing,
+// which holds for the consistent heuristic used; it beats the binary heap on large maps. The
+// wider heaps of PriorityQueue do not pay off here: in benchmarkOpenLists the 4-ary heap is no
+// faster than the binary heap and the 8-ary heap is the slowest of all.
+enum class OpenList { BinaryHeap, FourAryHeap, EightAryHeap, RadixHeap };
+
+// Pass stats to count expansions and time the search phases, see SearchStats.h.
+std::vector<Node> cpuAStar(const Graph &graph, const Position &source, const Position &destination,
+                           CpuSearchStats *stats = nullptr,
+                           OpenList        openList = OpenList::RadixHeap);
+
+// Batch version of the above, same result type as gpuAStar.
+PathSet cpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+                 CpuSearchStats *stats = nullptr, OpenList openList = OpenList::RadixHeap);
+
+// Weighted A* (f = g + weight * h). The reported bound is at most weight, often much tighter.
+BoundedPath cpuWeightedAStar(const Graph &graph, const Position &source,
+                             const Position &destination, float weight,
+                             CpuSearchStats *stats = nullptr);
+
+// Anytime weighted A* (ARA*): finds a first path with initialWeight, then keeps lowering the weight
+// by weightStep and improving the path until it is optimal or the deadline has passed. Every
+// improvement is passed to improved, the best one is returned.
+BoundedPath cpuAnytimeAStar(const Graph &graph, const Position &source,
+                            const Position &destination,
+                            std::chrono::steady_clock::time_point           deadline,
+                            const std::function<void(const BoundedPath &)> &improved = {},
+                            float initialWeight = 3.0f, float weightStep = 0.5f,
+                            CpuSearchStats *stats = nullptr);
+
+// The parallel GA* of gpuGAStar on CPU threads, without OpenCL: one open list per thread, rounds of
+// extract and expand, duplicate detection and push back, with the same termination. threads = 0
+// uses one per hardware thread.
+std::vector<Node> cpuGAStar(const Graph &graph, const Position &source, const Position &destination,
+                            unsigned threads = 0, CpuSearchStats *stats = nullptr);
+
+// Nearest goal query: a source and a set of goals
+using GoalQuery = std::pair<Position, std::vector<Position>>;
+
+// Path from source to the nearest of goals (the cheapest to reach), empty if none is reachable.
+// A* with the minimum of the heuristics over the goals, or with many goals from all goals at once
+// towards the source. Either way the search stops at the first goal settled, so a query costs
+// about one search instead of one per goal.
+std::vector<Node> cpuNearestAStar(const Graph &graph, const Position &source,
+                                  const std::vector<Position> &goals,
+                                  CpuSearchStats *             stats = nullptr);
 
-std::vector<std::vector<Node>>
+// Batch version of the above, same result type as gpuAStar.
+PathSet cpuNearestAStar(const Graph &graph, const std::vector<GoalQuery> &queries,
+                        CpuSearchStats *stats = nullptr);
+
+// Pass stats to enable kernel profiling and device side counters, see SearchStats.h.
+// A weight above 1 searches weighted A* (f = g + weight * h), the paths then cost at most weight
+// times the optimum. Identical and reversed queries are searched once, see searchUnique(); with a
+// cache, paths of earlier batches on the same map are reused.
+PathSet
 gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
-         const boost::compute::device &clDevice = boost::compute::system::default_device());
+         const boost::compute::device &clDevice = boost::compute::system::default_device(),
+         GpuSearchStats *stats = nullptr, float weight = 1.0f, PathCache *cache = nullptr);
+
+// How gpuAStar lays out the agents of a batch on a device. Open list entries beyond the local
+// memory per agent spill into global memory, and more local memory per agent leaves room for
+// fewer agents per work-group.
+struct GpuAStarLaunch {
+    std::size_t localBytesPerAgent = 0;
+    std::size_t workGroupSize = 0;
+    int         heapArity = 2; // children per node of the open list heaps, see HEAP_ARITY
+
+    // Measured by calibrateGpuAStar() on its sample
+    std::uint64_t spills = 0; // open list pushes beyond local memory
+    double        agentsPerSecond = 0.0;
+};
 
+// Calibration mode of gpuAStar: runs sampleList, which should be a typical batch, with a range of
+// launches and keeps the fastest for the device and the size class of the graph (number of nodes
+// rounded up to a power of two). Later gpuAStar calls on such graphs use it, others a guess.
+// All candidates use heapArity; calibrating with 2, 4 and 8 compares the kernel heaps on a device,
+// the last calibration is kept.
+GpuAStarLaunch calibrateGpuAStar(
+    const Graph &graph, const std::vector<std::pair<Position, Position>> &sampleList,
+    const boost::compute::device &clDevice = boost::compute::system::default_device(),
+    int heapArity = 2);
+
+// Split the batch over several devices in proportion to their measured throughput. Every device
+// gets its own copy of the graph; paths are returned in the order of srcDstList.
+PathSet
+gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+         const std::vector<boost::compute::device> &clDevices, GpuSearchStats *stats = nullptr,
+         float weight = 1.0f, PathCache *cache = nullptr);
+
+// cpuNearestAStar on the device, one agent per query.
+PathSet
+gpuNearestAStar(const Graph &graph, const std::vector<GoalQuery> &queries,
+                const boost::compute::device &clDevice = boost::compute::system::default_device(),
+                GpuSearchStats *stats = nullptr);
+
+// The search stops once no queue holds a node that could improve the best path found, so the
+// weight bounds the suboptimality like in gpuAStar. heapArity: children per node of the open list
+// heaps, compare the pushes and pops per second of kernel time in the stats when changing it.
 std::vector<Node>
 gpuGAStar(const Graph &graph, const Position &source, const Position &destination,
-          const boost::compute::device &clDevice = boost::compute::system::default_device());
+          const boost::compute::device &clDevice = boost::compute::system::default_device(),
+          GpuSearchStats *stats = nullptr, float weight = 1.0f, int heapArity = 2);
+
+// Search on a tiled graph, crossing tile boundaries as needed. Only the search state grows with
+// the number of expanded nodes, the costs are held in at most graph.maxResidentTiles() tiles.
+std::vector<Position> cpuAStar(TiledGraph &graph, const Position &source,
+                               const Position &destination, CpuSearchStats *stats = nullptr);
+
+// gpuGAStar on a window of whole tiles around source and destination. The window grows until the
+// path found in it is proven optimal: no path leaving the window can be cheaper. It is limited by
+// the device memory, a path found in the largest window that fits is returned without that proof.
+std::vector<Position>
+gpuGAStar(TiledGraph &graph, const Position &source, const Position &destination,
+          const boost::compute::device &clDevice = boost::compute::system::default_device(),
+          GpuSearchStats *stats = nullptr);
@@ -0,0 +1,187 @@
+#include "astar.h"
+
+#include "PriorityQueue.h"
+#include "SearchCore.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct OpenEntry {
+    OpenEntry(int _node, float _totalCost, float _priority)
+        : node(_node), totalCost(_totalCost), priority(_priority) {}
+
+    int   node;      // index into the graph
+    float totalCost; // g-value when queued, entries with outdated values are skipped
+    float priority;  // g + weight * h
+};
+
+// Comparator to put cheapest nodes first.
+struct Compare {
+    bool operator()(const OpenEntry &a, const OpenEntry &b) { return a.priority > b.priority; }
+};
+
+// ARA*, see Likhachev et al., "ARA*: Anytime A* with Provable Bounds on Sub-Optimality". Every
+// iteration is a weighted A* search that reuses the state of the previous one. Nodes are not
+// reopened within an iteration, but remembered as inconsistent and requeued for the next one.
+// The first path is always completed, later iterations are abandoned at the deadline.
+// Connectivity and Costs: the moves, heuristic and cost storage, see SearchCore.h
+template <typename Connectivity, typename Costs, typename Stats>
+BoundedPath search(const Graph &graph, const Position &source, const Position &destination,
+                   float weight, float weightStep, Clock::time_point deadline,
+                   const std::function<void(const BoundedPath &)> &improved, Stats &stats) {
+    if (source == destination)
+        return {{{graph, destination}}, 1.0f};
+
+    stats.beginSearch();
+
+    const Costs costs(graph);
+
+    const int width = graph.width(), height = graph.height();
+    auto      index = [width](const Position &p) { return p.y * width + p.x; };
+    auto      position = [width](int node) { return Position{node % width, node / width}; };
+    auto      heuristic = [&](int node) {
+        return Connectivity::distance(position(node), destination);
+    };
+
+    const float inf = std::numeric_limits<float>::infinity();
+    const int   sourceIndex = index(source);
+    const int   destIndex = index(destination);
+
+    std::vector<float>        totalCosts(graph.size(), inf);
+    std::vector<int>          predecessors(graph.size(), -1);
+    std::vector<std::uint8_t> closed(graph.size(), 0); // expanded in the current iteration
+    std::vector<std::uint8_t> inconsistent(graph.size(), 0);
+    std::vector<int>          inconsistentList;
+
+    PriorityQueue<OpenEntry, Compare> open;
+    auto valid = [&](const OpenEntry &entry) {
+        return !closed[entry.node] && entry.totalCost == totalCosts[entry.node];
+    };
+
+    totalCosts[sourceIndex] = 0.0f;
+    predecessors[sourceIndex] = sourceIndex;
+    open.emplace(sourceIndex, 0.0f, weight * heuristic(sourceIndex));
+
+    BoundedPath result;
+    std::size_t expansions = 0;
+
+    while (true) {
+        // Weighted A* until no queued node can lead to a cheaper path to the destination
+        bool timeout = false;
+        while (!open.empty()) {
+            const auto current = open.top();
+            if (!valid(current)) {
+                open.pop();
+                continue;
+            }
+            if (totalCosts[destIndex] <= current.priority)
+                break;
+            if (!result.path.empty() && ++expansions % 256 == 0 && Clock::now() >= deadline) {
+                timeout = true;
+                break;
+            }
+
+            stats.openSize(open.size());
+            open.pop();
+            closed[current.node] = 1;
+            stats.expanded(current.node);
+
+            Connectivity::expand(
+                costs, width, height, current.node, current.totalCost, destination,
+                [&](int nbNode, float nbTotalCost, float nbHeuristic) {
+                    if (totalCosts[nbNode] <= nbTotalCost)
+                        return;
+
+                    totalCosts[nbNode] = nbTotalCost;
+                    predecessors[nbNode] = current.node;
+                    stats.relaxed();
+
+                    if (!closed[nbNode])
+                        open.emplace(nbNode, nbTotalCost, nbTotalCost + weight * nbHeuristic);
+                    else if (!inconsistent[nbNode]) {
+                        inconsistent[nbNode] = 1;
+                        inconsistentList.push_back(nbNode);
+                    }
+                });
+        }
+
+        // Keep the last complete path, or give up if there is none at all.
+        if (timeout || totalCosts[destIndex] == inf)
+            break;
+
+        // Every node that may still lie on a cheaper path is queued or inconsistent, so the
+        // smallest unweighted f-value among them is a lower bound of the optimal cost.
+        float lowerBound = totalCosts[destIndex];
+        for (std::size_t i = 0; i < open.size(); ++i)
+            if (valid(open[i]))
+                lowerBound = std::min(lowerBound, open[i].totalCost + heuristic(open[i].node));
+        for (const auto node : inconsistentList)
+            lowerBound = std::min(lowerBound, totalCosts[node] + heuristic(node));
+
+        result.bound = std::min(weight, totalCosts[destIndex] / lowerBound);
+        result.path.clear();
+        for (int node = destIndex; node != sourceIndex; node = predecessors[node])
+            result.path.emplace_back(graph, position(node));
+        result.path.emplace_back(graph, source);
+        std::reverse(result.path.begin(), result.path.end());
+
+        if (improved)
+            improved(result);
+
+        if (result.bound <= 1.0f || weightStep <= 0.0f || Clock::now() >= deadline)
+            break;
+
+        // Next iteration: smaller weight, inconsistent nodes back into the open list and all
+        // priorities recomputed.
+        weight = std::max(1.0f, std::min(weight - weightStep, result.bound));
+
+        std::vector<OpenEntry> entries;
+        for (std::size_t i = 0; i < open.size(); ++i)
+            if (valid(open[i]))
+                entries.push_back(open[i]);
+        for (const auto node : inconsistentList) {
+            entries.emplace_back(node, totalCosts[node], 0.0f);
+            inconsistent[node] = 0;
+        }
+        inconsistentList.clear();
+        std::fill(closed.begin(), closed.end(), 0);
+
+        open = {};
+        for (auto &entry : entries) {
+            entry.priority = entry.totalCost + weight * heuristic(entry.node);
+            open.push(entry);
+        }
+    }
+
+    stats.endSearch();
+    return result;
+}
+} // namespace
+
+BoundedPath cpuWeightedAStar(const Graph &graph, const Position &source,
+                             const Position &destination, float weight, CpuSearchStats *stats) {
+    return cpuAnytimeAStar(graph, source, destination, Clock::time_point::max(), {}, weight, 0.0f,
+                           stats);
+}
+
+BoundedPath cpuAnytimeAStar(const Graph &graph, const Position &source,
+                            const Position &destination, Clock::time_point deadline,
+                            const std::function<void(const BoundedPath &)> &improved,
+                            float initialWeight, float weightStep, CpuSearchStats *stats) {
+    return dispatchConnectivity([&](auto connectivity) {
+        return dispatchCosts(graph, [&](auto costs) {
+            using Connectivity = typename decltype(connectivity)::type;
+            using Costs = typename decltype(costs)::type;
+            if (stats)
+                return search<Connectivity, Costs>(graph, source, destination, initialWeight,
+                                                   weightStep, deadline, improved, *stats);
+
+            NoSearchStats noStats;
+            return search<Connectivity, Costs>(graph, source, destination, initialWeight,
+                                               weightStep, deadline, improved, noStats);
+        });
+    });
+}
@@ -1,89 +1,54 @@
 #include "astar.h"
 
-#include "PriorityQueue.h"
-#include <map>
+#include "SearchCore.h"
+#include <algorithm>
 
 namespace {
-struct NodeCost {
-    NodeCost(Node _node, float _totalCost, float _heuristic, Node _predecessor)
-        : node(std::move(_node)), totalCost(_totalCost), heuristic(_heuristic),
-          predecessor(std::move(_predecessor)) {}
-
-    Node  node;
-    float totalCost;   // g-value
-    float heuristic;   // h-value
-    Node  predecessor; // to recreate path
-};
+// See Graph::connected()
+bool connected(const Graph &graph, const Position &a, const Position &b) {
+    return graph.connected(a.y * graph.width() + a.x, b.y * graph.width() + b.x);
+}
 
-// Comparator to put cheapest nodes first.
-struct Compare {
-    bool operator()(const NodeCost &a, const NodeCost &b) {
-        return a.totalCost + a.heuristic > b.totalCost + b.heuristic;
-    }
-};
+template <typename Core, typename Stats>
+std::vector<Node> search(const Graph &graph, Core &core, const Position &source,
+                         const Position &destination, Stats &stats) {
+    if (source == destination)
+        return {{graph, destination}};
+
+    const int width = graph.width();
+    auto      path = core.search({source.y * width + source.x},
+                                 {destination.y * width + destination.x}, stats);
+    std::reverse(path.begin(), path.end());
+    return path;
+}
 } // namespace
 
-// Implementation like in https://de.wikipedia.org/wiki/A*-Algorithmus#Funktionsweise
-std::vector<Node> cpuAStar(const Graph &graph, const Position &source,
-                           const Position &destination) {
-	if (source == destination)
-		return {{graph, destination}};
-
-    // Open and closed list
-    PriorityQueue<NodeCost, Compare> open;
-    // (Tree) map seems to perform _much_ better than the unordered hash map!
-    std::map<Node, Node> closed; // store predecessor as value to recreate path
+std::vector<Node> cpuAStar(const Graph &graph, const Position &source, const Position &destination,
+                           CpuSearchStats *stats, OpenList openList) {
+    if (!connected(graph, source, destination))
+        return {};
 
-    // Begin at source
-    const Node sourceNode(graph, source);
-    open.emplace(sourceNode, 0.0f, 0.0f, sourceNode);
-
-    while (!open.empty()) {
-        const auto current = open.top();
-        open.pop();
-
-        // Reached destination! Restore path and return.
-        if (current.node.position() == destination) {
-            std::vector<Node> result = {current.node, current.predecessor};
+    return dispatchSearch<SingleTarget>(
+        graph, openList, stats,
+        [&](auto &core, auto &stats) { return search(graph, core, source, destination, stats); });
+}
 
-            for (auto it = closed.find(result.back()); it->second != result.back();
-                 it = closed.find(result.back())) {
-                result.push_back(it->second);
+PathSet cpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+                 CpuSearchStats *stats, OpenList openList) {
+    PathSet paths(graph.width());
+    paths.reserve(srcDstList.size(), 0);
+
+    // One instantiation for the whole batch, which keeps its state over the searches
+    dispatchSearch<SingleTarget>(graph, openList, stats, [&](auto &core, auto &stats) {
+            for (const auto &srcDst : srcDstList) {
+                // Rejected without a search, which would exhaust the component of the source
+                if (!connected(graph, srcDst.first, srcDst.second)) {
+                    paths.push_back({});
+                    continue;
+                }
+                paths.push_back(search(graph, core, srcDst.first, srcDst.second, stats));
             }
+        });
 
-            std::reverse(result.begin(), result.end());
-
-            return result;
-        }
-
-        closed.emplace(current.node, current.predecessor);
-
-        // Expand node
-        for (const auto &neighbor : current.node.neighbors()) {
-            const auto &nbNode = neighbor.first;
-            const auto &nbStepCost = neighbor.second;
-
-            // Already visited (cycle)
-            if (closed.count(nbNode) != 0)
-                continue;
-
-            const auto nbTotalCost = current.totalCost + nbStepCost;
-            const auto nbIndex =
-                open.find_if([&](const NodeCost &nc) { return nc.node == nbNode; });
-
-            // Node already queued for visiting and other path cost is equal or better
-            if (nbIndex < open.size() && open[nbIndex].totalCost <= nbTotalCost)
-                continue;
-
-            const auto nbHeuristic = (destination - nbNode.position()).length();
-
-            if (nbIndex < open.size())
-                open.update(nbIndex, {nbNode, nbTotalCost, nbHeuristic, current.node});
-            else
-                open.emplace(nbNode, nbTotalCost, nbHeuristic, current.node);
-        }
-    }
-
-    // No path found
-    return {};
+    return paths;
 }
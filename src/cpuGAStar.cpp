@@ -0,0 +1,324 @@
+#include "astar.h"
+
+#include "Connectivity.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+// Nodes every worker takes from its open list per round. More means fewer barriers, but more
+// nodes expanded that turn out not to be needed.
+const std::size_t nodesPerRound = 32;
+
+// Non-negative floats compare like their bits as unsigned integers, see extractAndExpand. Cost
+// and predecessor are packed into one word, so both are updated together by an atomic minimum.
+std::uint64_t pack(float cost, std::uint32_t predecessor) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &cost, sizeof(bits));
+    return (std::uint64_t) bits << 32 | predecessor;
+}
+float cost(std::uint64_t packed) {
+    const auto bits = (std::uint32_t)(packed >> 32);
+    float      cost;
+    std::memcpy(&cost, &bits, sizeof(cost));
+    return cost;
+}
+std::uint32_t predecessor(std::uint64_t packed) { return (std::uint32_t) packed; }
+
+const std::uint64_t unreached = pack(std::numeric_limits<float>::infinity(), ~0u);
+
+// Returns true if value was smaller and has been stored.
+bool atomicMin(std::atomic<std::uint64_t> &target, std::uint64_t value) {
+    auto old = target.load(std::memory_order_relaxed);
+    while (value < old)
+        if (target.compare_exchange_weak(old, value, std::memory_order_relaxed))
+            return true;
+    return false;
+}
+
+// Reusable barrier, C++14 has none.
+class Barrier {
+public:
+    explicit Barrier(std::size_t count) : m_count(count) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto                   generation = m_generation;
+        if (++m_waiting == m_count) {
+            m_waiting = 0;
+            ++m_generation;
+            m_condition.notify_all();
+        } else {
+            m_condition.wait(lock, [&] { return generation != m_generation; });
+        }
+    }
+
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_condition;
+    std::size_t             m_count;
+    std::size_t             m_waiting = 0;
+    std::size_t             m_generation = 0;
+};
+
+// Open addressing hash table of the successors generated in one round, keeping the cheapest one
+// per node. Lock-free: slots are claimed and improved with compare and swap.
+class SuccessorTable {
+public:
+    explicit SuccessorTable(std::size_t minSize) {
+        std::size_t size = 1;
+        while (size < 2 * minSize)
+            size *= 2;
+        m_keys = std::vector<std::atomic<std::uint32_t>>(size);
+        m_values = std::vector<std::atomic<std::uint64_t>>(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            m_keys[i].store(empty, std::memory_order_relaxed);
+            m_values[i].store(unreached, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the slot if this call claimed it for node, otherwise -1.
+    std::ptrdiff_t insert(std::uint32_t node, std::uint64_t value) {
+        const auto mask = m_keys.size() - 1;
+        for (auto slot = (node * 2654435761u) & mask;; slot = (slot + 1) & mask) {
+            auto key = m_keys[slot].load(std::memory_order_relaxed);
+            const bool claimed = key == empty && m_keys[slot].compare_exchange_strong(
+                                                     key, node, std::memory_order_relaxed);
+            if (claimed || key == node) {
+                atomicMin(m_values[slot], value);
+                return claimed ? (std::ptrdiff_t) slot : -1;
+            }
+        }
+    }
+
+    // Cheapest value of a claimed slot, which is freed for the next round
+    std::uint64_t take(std::size_t slot) {
+        const auto value = m_values[slot].exchange(unreached, std::memory_order_relaxed);
+        m_keys[slot].store(empty, std::memory_order_relaxed);
+        return value;
+    }
+
+private:
+    static const std::uint32_t empty = ~0u;
+
+    std::vector<std::atomic<std::uint32_t>> m_keys;
+    std::vector<std::atomic<std::uint64_t>> m_values;
+};
+
+struct OpenEntry {
+    std::uint32_t node;
+    float         totalCost; // g when pushed, outdated if the node got cheaper since
+    float         priority;  // g + h
+};
+
+// Comparator to put cheapest nodes first.
+struct Compare {
+    bool operator()(const OpenEntry &a, const OpenEntry &b) { return a.priority > b.priority; }
+};
+
+struct Worker {
+    std::vector<OpenEntry>                               open;       // binary heap
+    std::vector<std::pair<std::size_t, std::uint32_t>> claimed;    // table slot, node: "S" list
+    std::vector<OpenEntry>                               successors; // improving ones: "T" list
+    std::uint64_t                                        expansions = 0;
+    std::uint64_t                                        relaxations = 0;
+    std::size_t                                          openHighWater = 0;
+
+    // Only with a heatmap: expansions per node, and the open list after the last round
+    std::vector<std::uint32_t> heat;
+    std::vector<std::uint32_t> frontier;
+};
+} // namespace
+
+std::vector<Node> cpuGAStar(const Graph &graph, const Position &source,
+                            const Position &destination, unsigned threads, CpuSearchStats *stats) {
+    if (source == destination)
+        return {{graph, destination}};
+
+    if (stats)
+        stats->beginSearch();
+
+    const std::size_t workerCount =
+        threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+
+    const int  width = graph.width();
+    auto       index = [width](int x, int y) { return (std::uint32_t)(y * width + x); };
+    const auto sourceIndex = index(source.x, source.y);
+    const auto destIndex = index(destination.x, destination.y);
+
+    auto heuristic = [&](std::uint32_t node) {
+        return GraphMoves::distance({(int) (node % width), (int) (node / width)}, destination);
+    };
+
+    // Cheapest known cost and predecessor per node
+    std::vector<std::atomic<std::uint64_t>> best(graph.size());
+    for (auto &entry : best)
+        entry.store(unreached, std::memory_order_relaxed);
+    best[sourceIndex].store(pack(0.0f, sourceIndex));
+
+    std::vector<Worker> workers(workerCount);
+    workers.front().open.push_back({sourceIndex, 0.0f, heuristic(sourceIndex)});
+
+    Heatmap *heatmap = stats ? stats->heatmap : nullptr;
+    if (heatmap && (heatmap->width() != width || heatmap->height() != graph.height()))
+        heatmap = nullptr;
+    if (heatmap)
+        for (auto &worker : workers)
+            worker.heat.resize(graph.size());
+
+    SuccessorTable             table(workerCount * nodesPerRound * GraphMoves::moveCount);
+    std::atomic<std::uint32_t> bestCost{0x7f800000u}; // of the destination, as float bits
+    std::atomic<bool>          running{false};
+    Barrier                    barrier(workerCount);
+    std::size_t                rotation = 0; // changed by the first worker between barriers
+
+    auto work = [&](std::size_t id) {
+        auto &  worker = workers[id];
+        auto &  open = worker.open;
+        Compare compare;
+
+        while (true) {
+            // Extract and expand: the cheapest few nodes, as long as they could still lead to a
+            // cheaper path to the destination.
+            for (std::size_t i = 0; i < nodesPerRound && !open.empty(); ++i) {
+                const auto current = open.front();
+                if (current.priority >= cost((std::uint64_t) bestCost.load() << 32))
+                    break;
+
+                running.store(true, std::memory_order_relaxed);
+                std::pop_heap(open.begin(), open.end(), compare);
+                open.pop_back();
+
+                if (current.totalCost > cost(best[current.node].load(std::memory_order_relaxed)))
+                    continue; // outdated, a cheaper path to the node was found meanwhile
+
+                if (current.node == destIndex) {
+                    const auto bits = (std::uint32_t)(pack(current.totalCost, 0) >> 32);
+                    auto       old = bestCost.load();
+                    while (bits < old && !bestCost.compare_exchange_weak(old, bits))
+                        ;
+                    continue;
+                }
+
+                ++worker.expansions;
+                if (heatmap)
+                    ++worker.heat[current.node];
+                const int   x = current.node % width, y = current.node / width;
+                const float nodeCost = graph.cost(current.node);
+                for (int move = 0; move < GraphMoves::moveCount; ++move) {
+                    const int nbX = x + GraphMoves::moveX(move), nbY = y + GraphMoves::moveY(move);
+                    if (nbX < 0 || nbY < 0 || nbX >= width || nbY >= graph.height())
+                        continue;
+
+                    // Same as Graph::pathCost()
+                    const auto  nbNode = index(nbX, nbY);
+                    const float stepCost = std::max(nodeCost, graph.cost(nbNode));
+                    const bool  diagonal = GraphMoves::diagonal(move);
+                    const float nbTotalCost =
+                        current.totalCost + (diagonal ? 1.41421356237f * stepCost : stepCost);
+
+                    // Duplicate detection: only successors that improve on the known cost pass,
+                    // the cheapest per node of this round is kept by the table.
+                    if (nbTotalCost >= cost(best[nbNode].load(std::memory_order_relaxed)))
+                        continue;
+
+                    const auto slot = table.insert(nbNode, pack(nbTotalCost, current.node));
+                    if (slot >= 0)
+                        worker.claimed.emplace_back((std::size_t) slot, nbNode);
+                }
+            }
+
+            barrier.wait();
+            if (!running.load(std::memory_order_relaxed))
+                break; // every queue idle, same as returnCode 2 in gpuGAStar
+
+            // Keep the successors that still improve the known cost after this round.
+            worker.successors.clear();
+            for (const auto &claimed : worker.claimed) {
+                const auto value = table.take(claimed.first);
+                if (atomicMin(best[claimed.second], value)) {
+                    const auto totalCost = cost(value);
+                    worker.successors.push_back(
+                        {claimed.second, totalCost, totalCost + heuristic(claimed.second)});
+                    ++worker.relaxations;
+                }
+            }
+            worker.claimed.clear();
+
+            barrier.wait();
+            if (id == 0)
+                running.store(false, std::memory_order_relaxed);
+
+            // Push back: the successors of all workers are dealt round-robin to the open lists,
+            // starting at a different one every round. See computeAndPushBack.
+            std::size_t offset = rotation;
+            for (const auto &other : workers) {
+                const auto first = (id + workerCount - offset % workerCount) % workerCount;
+                for (auto i = first; i < other.successors.size(); i += workerCount) {
+                    open.push_back(other.successors[i]);
+                    std::push_heap(open.begin(), open.end(), compare);
+                }
+                offset += other.successors.size();
+            }
+            worker.openHighWater = std::max(worker.openHighWater, open.size());
+            if (heatmap) {
+                worker.frontier.clear();
+                for (const auto &entry : open)
+                    worker.frontier.push_back(entry.node);
+            }
+
+            barrier.wait();
+            if (id == 0) {
+                ++rotation;
+
+                // The other workers only extract until the next push back.
+                if (heatmap) {
+                    std::vector<std::uint32_t> frontier;
+                    for (const auto &other : workers)
+                        frontier.insert(frontier.end(), other.frontier.begin(),
+                                        other.frontier.end());
+                    heatmap->addFrontier(std::move(frontier));
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t id = 1; id < workerCount; ++id)
+        pool.emplace_back(work, id);
+    work(0);
+    for (auto &thread : pool)
+        thread.join();
+
+    std::vector<Node> path;
+    if (cost(best[destIndex].load()) != std::numeric_limits<float>::infinity()) {
+        if (stats)
+            stats->foundPath();
+
+        // Recreate path
+        for (auto node = destIndex; node != sourceIndex;
+             node = predecessor(best[node].load(std::memory_order_relaxed)))
+            path.emplace_back(graph, (int) (node % width), (int) (node / width));
+        path.emplace_back(graph, source);
+        std::reverse(path.begin(), path.end());
+    }
+
+    if (stats) {
+        for (const auto &worker : workers) {
+            stats->expansions += worker.expansions;
+            stats->relaxations += worker.relaxations;
+            stats->openSize(worker.openHighWater);
+            if (heatmap)
+                heatmap->add(worker.heat);
+        }
+        stats->endSearch();
+    }
+
+    return path;
+}
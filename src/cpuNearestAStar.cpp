@@ -0,0 +1,62 @@
+#include "astar.h"
+
+#include "SearchCore.h"
+#include <algorithm>
+
+namespace {
+// With more goals, the search runs from all goals towards the source instead: the minimum over
+// the goals would cost more per relaxation than it saves.
+const std::size_t maxHeuristicGoals = 8;
+
+template <typename Core, typename Stats>
+std::vector<Node> nearest(const Graph &graph, Core &core, const Position &source,
+                          const std::vector<Position> &goals, Stats &stats) {
+    const int width = graph.width();
+    const int sourceIndex = source.y * width + source.x;
+
+    // Goals outside the component of the source would never be reached.
+    std::vector<int> targets;
+    for (const auto &goal : goals) {
+        const int goalIndex = goal.y * width + goal.x;
+        if (goalIndex == sourceIndex)
+            return {{graph, source}};
+        if (graph.connected(sourceIndex, goalIndex))
+            targets.push_back(goalIndex);
+    }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+    if (targets.empty())
+        return {};
+    if (targets.size() <= maxHeuristicGoals) {
+        auto path = core.search({sourceIndex}, targets, stats);
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
+    // From all goals at once to the source, the path found leads from the source back to the
+    // nearest goal. Graph::pathCost() is symmetric, so it is the path searched for.
+    return core.search(targets, {sourceIndex}, stats);
+}
+} // namespace
+
+// The minimum over the goals is consistent, so the radix heap fits as the open list.
+std::vector<Node> cpuNearestAStar(const Graph &graph, const Position &source,
+                                  const std::vector<Position> &goals, CpuSearchStats *stats) {
+    return dispatchSearch<NearestTarget>(
+        graph, OpenList::RadixHeap, stats,
+        [&](auto &core, auto &stats) { return nearest(graph, core, source, goals, stats); });
+}
+
+PathSet cpuNearestAStar(const Graph &graph, const std::vector<GoalQuery> &queries,
+                        CpuSearchStats *stats) {
+    PathSet paths(graph.width());
+    paths.reserve(queries.size(), 0);
+
+    dispatchSearch<NearestTarget>(graph, OpenList::RadixHeap, stats, [&](auto &core, auto &stats) {
+        for (const auto &query : queries)
+            paths.push_back(nearest(graph, core, query.first, query.second, stats));
+    });
+
+    return paths;
+}
@@ -0,0 +1,116 @@
+#include "astar.h"
+
+#include "Connectivity.h"
+#include "PriorityQueue.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+struct OpenEntry {
+    OpenEntry(std::int64_t _node, float _totalCost, float _priority)
+        : node(_node), totalCost(_totalCost), priority(_priority) {}
+
+    std::int64_t node;      // global index y * width + x, may exceed 32 bits
+    float        totalCost; // g-value when queued, entries with outdated values are skipped
+    float        priority;  // g + h
+};
+
+// Comparator to put cheapest nodes first.
+struct Compare {
+    bool operator()(const OpenEntry &a, const OpenEntry &b) { return a.priority > b.priority; }
+};
+
+// Search state of a node that has been reached, only these are stored.
+struct NodeState {
+    float        totalCost;
+    std::int64_t predecessor;
+    bool         closed;
+};
+
+template <typename Stats>
+std::vector<Position> search(TiledGraph &graph, const Position &source,
+                             const Position &destination, Stats &stats) {
+    if (source == destination)
+        return {destination};
+
+    stats.beginSearch();
+
+    const std::int64_t width = graph.width();
+    auto               index = [width](const Position &p) { return p.y * width + p.x; };
+    auto position = [width](std::int64_t node) {
+        return Position{(int) (node % width), (int) (node / width)};
+    };
+
+    const auto sourceIndex = index(source);
+    const auto destIndex = index(destination);
+
+    std::unordered_map<std::int64_t, NodeState> states;
+    PriorityQueue<OpenEntry, Compare>           open;
+
+    states[sourceIndex] = {0.0f, sourceIndex, false};
+    open.emplace(sourceIndex, 0.0f, GraphMoves::distance(source, destination));
+
+    while (!open.empty()) {
+        stats.openSize(open.size());
+        const auto current = open.top();
+        open.pop();
+
+        auto &state = states[current.node];
+        if (state.closed || current.totalCost != state.totalCost)
+            continue; // outdated entry
+
+        // Reached destination! Restore path and return.
+        if (current.node == destIndex) {
+            stats.foundPath();
+            std::vector<Position> path;
+            for (auto node = destIndex; node != sourceIndex; node = states[node].predecessor)
+                path.push_back(position(node));
+            path.push_back(source);
+            std::reverse(path.begin(), path.end());
+
+            stats.endSearch();
+            return path;
+        }
+
+        state.closed = true;
+        stats.expanded(current.node);
+
+        // Neighbors may lie in other tiles, which are loaded on access.
+        const auto currentPosition = position(current.node);
+        for (int move = 0; move < GraphMoves::moveCount; ++move) {
+            const Position nbPosition = {currentPosition.x + GraphMoves::moveX(move),
+                                         currentPosition.y + GraphMoves::moveY(move)};
+            if (!graph.inBounds(nbPosition))
+                continue;
+
+            const auto nbIndex = index(nbPosition);
+            const auto nbTotalCost =
+                current.totalCost + graph.pathCost(currentPosition, nbPosition);
+
+            auto it = states.find(nbIndex);
+            if (it != states.end() && (it->second.closed || it->second.totalCost <= nbTotalCost))
+                continue;
+
+            states[nbIndex] = {nbTotalCost, current.node, false};
+            stats.relaxed();
+            open.emplace(nbIndex, nbTotalCost,
+                         nbTotalCost + GraphMoves::distance(nbPosition, destination));
+        }
+    }
+
+    // No path found
+    stats.endSearch();
+    return {};
+}
+} // namespace
+
+std::vector<Position> cpuAStar(TiledGraph &graph, const Position &source,
+                               const Position &destination, CpuSearchStats *stats) {
+    if (stats)
+        return search(graph, source, destination, *stats);
+
+    NoSearchStats noStats;
+    return search(graph, source, destination, noStats);
+}
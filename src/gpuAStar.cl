@@ -3,6 +3,18 @@
 #define DEBUG 0
 #define SQRT2 1.41421356237f
 
+#ifndef COST_T
+#define COST_T float // per-node cost storage, see Graph::quantizeCosts()
+#endif
+
+#ifndef HEURISTIC_WEIGHT
+#define HEURISTIC_WEIGHT 1.0f // weighted A* above 1, paths cost at most this times the optimum
+#endif
+
+#ifndef HEAP_ARITY
+#define HEAP_ARITY 2 // children per open list node, wider heaps are shallower
+#endif
+
 // ----- Types ----------------------------------------------------------------
 typedef struct {
     uint  first;
@@ -14,14 +26,15 @@ typedef struct {
     const    size_t      localSize;
     __global uint_float *globalExt;
              size_t      size;
+#ifdef SEARCH_COUNTERS
+             uint        pushes;
+             uint        pops;
+             uint        spills; // pushes beyond local memory
+#endif
 } OpenList;
 
-typedef struct {
-    uint  closed;
-    float totalCost;
-    uint  predecessor;
-    uint  _reserved; // for memory alignment
-} Info;
+// Per-node search state is kept as structure of arrays: one bit per node for the closed list, a
+// separate array for the total costs and one for the predecessors.
 
 // ----- Helper ---------------------------------------------------------------
 uint_float _read_heap(OpenList *open, size_t index) {
@@ -37,6 +50,15 @@ void _write_heap(OpenList *open, size_t index, uint_float value) {
         open->globalExt[index - open->localSize] = value;
 }
 
+// ----- Closed list functions ------------------------------------------------
+bool is_closed(__global const uint *closed, uint node) {
+    return (closed[node / 32] >> (node % 32)) & 1;
+}
+
+void set_closed(__global uint *closed, uint node) {
+    closed[node / 32] |= 1u << (node % 32);
+}
+
 // ----- OpenList functions ---------------------------------------------------
 uint top(OpenList *open) {
     return open->localMem[0].first;
@@ -46,7 +68,7 @@ void _push_impl(OpenList *open, size_t *size, uint value, float cost) {
     size_t index = (*size)++;
 
     while (index > 0) {
-        size_t parent = (index - 1) / 2;
+        size_t parent = (index - 1) / HEAP_ARITY;
 
         uint_float pValue = _read_heap(open, parent);
         if (cost < pValue.second) {
@@ -60,6 +82,11 @@ void _push_impl(OpenList *open, size_t *size, uint value, float cost) {
 }
 
 void push(OpenList *open, uint value, float cost) {
+#ifdef SEARCH_COUNTERS
+    ++open->pushes;
+    if (open->size >= open->localSize)
+        ++open->spills;
+#endif
     _push_impl(open, &open->size, value, cost);
 }
 
@@ -68,19 +95,25 @@ void update(OpenList *open, size_t index, uint value, float cost) {
 }
 
 void pop(OpenList *open) {
+#ifdef SEARCH_COUNTERS
+    ++open->pops;
+#endif
     uint_float value = _read_heap(open, --(open->size));
     size_t     index = 0;
 
-    while (index < open->size / 2) {
-        size_t child = index * 2 + 1;
+    while (index * HEAP_ARITY + 1 < open->size) {
+        size_t first = index * HEAP_ARITY + 1;
+        size_t last  = first + HEAP_ARITY < open->size ? first + HEAP_ARITY : open->size;
+        size_t child = first;
 
+        // Cheapest child, all of them lie next to each other
         uint_float cValue = _read_heap(open, child);
-        if (child + 1 < open->size) {
-            uint_float c1Value = _read_heap(open, child + 1);
+        for (size_t other = first + 1; other < last; ++other) {
+            uint_float oValue = _read_heap(open, other);
 
-            if (c1Value.second < cValue.second) {
-                ++child;
-                cValue = c1Value;
+            if (oValue.second < cValue.second) {
+                child = other;
+                cValue = oValue;
             }
         }
 
@@ -106,20 +139,11 @@ uint find(OpenList *open, uint value) {
 
 #if DEBUG
 bool is_heap(OpenList *open) {
-    for (size_t index = 0; index < open->size / 2; ++index) {
-        uint_float value = _read_heap(open, index);
-        size_t     left   = index * 2 + 1;
-        size_t     right  = index * 2 + 2;
-
-        uint_float lValue = _read_heap(open, left);
-        if (lValue.second < value.second)
+    for (size_t index = 1; index < open->size; ++index) {
+        uint_float value  = _read_heap(open, index);
+        uint_float pValue = _read_heap(open, (index - 1) / HEAP_ARITY);
+        if (value.second < pValue.second)
             return false;
-
-        if (right < open->size) {
-            uint_float rValue = _read_heap(open, right);
-            if (rValue.second < value.second)
-                return false;
-        }
     }
 
     return true;
@@ -127,6 +151,19 @@ bool is_heap(OpenList *open) {
 #endif
 
 // ----- Kernel logic ---------------------------------------------------------
+// Same as Graph::pathCost(). Costs are stored per node, scaled by costScale.
+float step_cost(__global const int2   *nodes,
+                __global const COST_T *costs,
+                         const float   costScale,
+                               uint    source,
+                               uint    destination)
+{
+    const float cost = max(costs[source], costs[destination]) * costScale;
+    const int2  src  = nodes[source];
+    const int2  dst  = nodes[destination];
+    return src.x != dst.x && src.y != dst.y ? SQRT2 * cost : cost;
+}
+
 // http://theory.stanford.edu/~amitp/GameProgramming/Heuristics.html#diagonal-distance
 float heuristic(int2 source, int2 destination) {
     const int dx = abs(destination.x - source.x);
@@ -134,46 +171,95 @@ float heuristic(int2 source, int2 destination) {
     return (dx + dy) + (SQRT2 - 2) * min(dx, dy);
 }
 
-size_t recreate_path(__global const int2  *nodes,
-                     __global       int2  *path,
-                                    ulong  maxPathLength,
-                     __global       Info  *info,
-                                    uint   destination)
+#ifdef MULTI_GOAL
+// Agents search from any of their starts to the nearest of their targets, both are ranges of the
+// goals buffer. The minimum of the heuristics over all targets stays admissible and consistent.
+bool is_target(__global const uint *goals, uint2 targets, uint node) {
+    for (uint i = targets.x; i != targets.y; ++i)
+        if (goals[i] == node)
+            return true;
+
+    return false;
+}
+
+float targets_heuristic(__global const int2 *nodes,
+                        __global const uint *goals,
+                                 uint2       targets,
+                                 int2        position)
 {
-    // TODO: optimize! (Re-)Use local memory!
+    float result = INFINITY;
+    for (uint i = targets.x; i != targets.y; ++i)
+        result = min(result, heuristic(position, nodes[goals[i]]));
 
-    path[0] = nodes[destination];
-    size_t length = 1;
+    return result;
+}
+#endif
 
-    uint node        = destination;
-    uint predecessor = info[node].predecessor;
+// ----- Path encoding --------------------------------------------------------
+// Paths are stored as 3 bit move directions, starting at the source of the query. Directions are
+// numbered row by row through the 3x3 neighborhood, skipping the center:
+//   0 1 2
+//   3 - 4
+//   5 6 7
+#define MOVE_BITS 3
 
-    while (length < maxPathLength && node != predecessor) {
-        node           = predecessor;
-        predecessor    = info[node].predecessor;
-        path[length++] = nodes[node];
-    }
+uint path_length(__global const uint *predecessors, uint destination) {
+    uint length = 1;
 
-    // Note: path is in inverse order!
+    for (uint node = destination; predecessors[node] != node; node = predecessors[node])
+        ++length;
 
     return length;
 }
 
+uint path_bytes(uint length) {
+    return ((length - 1) * MOVE_BITS + 7) / 8;
+}
+
+uint move_direction(int2 from, int2 to) {
+    const uint direction = (to.y - from.y + 1) * 3 + (to.x - from.x + 1);
+    return direction > 4 ? direction - 1 : direction;
+}
+
+void write_move(__global uchar *path, uint move, uint direction) {
+    const uint bit   = move * MOVE_BITS;
+    const uint shift = bit % 8;
+
+    path[bit / 8] |= (uchar) (direction << shift);
+    if (shift > 8 - MOVE_BITS)
+        path[bit / 8 + 1] |= (uchar) (direction >> (8 - shift));
+}
+
 __kernel void gpuAStar(__global const int2       *nodes,            // x, y
                                 const ulong       nodesSize,
-                       __global const uint_float *edges,            // destination index, stepCost
+                       __global const uint       *edges,            // destination index
                                 const ulong       edgesSize,
+                       __global const COST_T     *costs,            // per node
+                                const float       costScale,
                        __global const uint2      *adjacencyMap,     // edges_begin, edges_end
                                 const ulong       adjacencyMapSize,
                                 const ulong       numberOfAgents,   // provides offset for per-thread arguments below
          /* input:  */ __global const uint2      *srcDstList,       // source id, destination id
-         /* output: */ __global       int2       *paths,            // x, y; offset = GID * maxPathLength;
-                                const ulong       maxPathLength,
+         /* output: */ __global       uint       *pathBytes,        // size of encoded path, see encodePaths
                        __local        uint_float *openLocal,        // open lists: id, cost
                                 const ulong       openLocalSize,    // per agent (local memory) open list size
                        __global       uint_float *openGlobalExt,    // open lists: id, cost; fallback if out of local memory
-                       __global       Info       *infos,            // closed lists, see members at the top
-                       __global       int2       *retCodeLength)    // return code and length of path
+                       __global       uint       *closedLists,      // one bit per node
+                       __global       float      *totalCostLists,   // g-values
+                       __global       uint       *predecessorLists, // to recreate paths
+                       __global       int2       *retCodeLength     // return code and length of path
+#ifdef MULTI_GOAL
+                     , __global const uint       *goals             // start and target ids of all agents
+                     , __global const uint4      *goalRanges        // starts begin, end, targets begin, end
+                     , __global       uint       *reachedTargets    // target the path leads to
+#endif
+#ifdef SEARCH_COUNTERS
+                     , __global       uint4      *counters          // expanded, pushes, pops, spills
+#endif
+#ifdef EXPANSION_HEATMAP
+                     , __global       uint       *heatmap           // expansions per node, all agents
+#endif
+                      )
 {
     const size_t GID = get_global_id(0);
     const size_t LID = get_local_id(0);
@@ -186,20 +272,47 @@ __kernel void gpuAStar(__global const int2       *nodes,            // x, y
                      openGlobalExt + GID * nodesSize,
                      0};
 
-    __global Info *info = infos + GID * nodesSize;
+#ifdef SEARCH_COUNTERS
+    uint expanded = 0;
+#define WRITE_COUNTERS() counters[GID] = (uint4){expanded, open.pushes, open.pops, open.spills}
+#else
+#define WRITE_COUNTERS()
+#endif
+
+    const size_t closedSize = (nodesSize + 31) / 32;
+    __global uint  *closed       = closedLists + GID * closedSize;
+    __global float *totalCosts   = totalCostLists + GID * nodesSize;
+    __global uint  *predecessors = predecessorLists + GID * nodesSize;
 
-    const uint source      = srcDstList[GID].x;
-    const uint destination = srcDstList[GID].y;
+    // Only the closed list needs initialization, the others are written before they are read.
+    for (size_t i = 0; i < closedSize; ++i)
+        closed[i] = 0;
 
     // Initialize result in case no path is found.
-    // If the first node in path is not source, we can expect a failure.
-    paths[GID * maxPathLength] = nodes[destination];
+    pathBytes[GID]     = 0;
     retCodeLength[GID] = (int2){1, 0}; // failure: no path found!
 
-    info[source].predecessor = source; // to recreate path
+#ifdef MULTI_GOAL
+    // srcDstList is not used, the goals take its place.
+    const uint4 ranges  = goalRanges[GID];
+    const uint2 targets = (uint2){ranges.z, ranges.w};
+
+    // Begin at all starts
+    for (uint i = ranges.x; i != ranges.y; ++i) {
+        totalCosts[goals[i]]   = 0.0f;
+        predecessors[goals[i]] = goals[i]; // to recreate path
+        push(&open, goals[i], 0.0f);
+    }
+#else
+    const uint source      = srcDstList[GID].x;
+    const uint destination = srcDstList[GID].y;
+
+    totalCosts[source]   = 0.0f;
+    predecessors[source] = source; // to recreate path
 
     // Begin at source
     push(&open, source, 0.0f);
+#endif
 
     while (open.size > 0) {
         const uint current = top(&open);
@@ -209,50 +322,62 @@ __kernel void gpuAStar(__global const int2       *nodes,            // x, y
         // DEBUG: heap after pop
         if (!is_heap(&open)) {
             retCodeLength[GID] = (int2){90, 0};
+            WRITE_COUNTERS();
             return; // error: broken heap!
         }
 #endif
 
+#ifdef MULTI_GOAL
+        if (is_target(goals, targets, current)) {
+            reachedTargets[GID] = current;
+#else
         if (current == destination) {
-            size_t length = recreate_path(nodes, paths + GID * maxPathLength,
-                                          maxPathLength, info, destination);
-            retCodeLength[GID] = (int2){
-                length < maxPathLength ?
-                    0 : // success: path found!
-                    2,  // failure: path too long!
-                length};
+#endif
+            const uint length = path_length(predecessors, current);
+            pathBytes[GID]     = path_bytes(length);
+            retCodeLength[GID] = (int2){0, length}; // success: path found!
+            WRITE_COUNTERS();
             return;
         }
 
-        info[current].closed = 1; // close node
-        const float totalCost = info[current].totalCost;
+        set_closed(closed, current);
+#ifdef SEARCH_COUNTERS
+        ++expanded;
+#endif
+#ifdef EXPANSION_HEATMAP
+        atomic_inc(heatmap + current);
+#endif
+        const float totalCost = totalCosts[current];
 
+#ifndef MULTI_GOAL
         const int2 destNode = nodes[destination];
+#endif
 
         const uint2 edgeRange = adjacencyMap[current];
         for (uint edge = edgeRange.x; edge != edgeRange.y; ++edge) {
-            const uint  nbNode     = edges[edge].first;
-            const float nbStepCost = edges[edge].second;
-            Info        nbInfo     = info[nbNode];
+            const uint nbNode = edges[edge];
 
-            if (nbInfo.closed == 1)
+            if (is_closed(closed, nbNode))
                 continue;
 
+            const float nbStepCost  = step_cost(nodes, costs, costScale, current, nbNode);
             const float nbTotalCost = totalCost + nbStepCost;
             const uint  nbIndex = find(&open, nbNode);
 
-            if (nbIndex < open.size && nbInfo.totalCost <= nbTotalCost)
+            if (nbIndex < open.size && totalCosts[nbNode] <= nbTotalCost)
                 continue;
 
-            nbInfo.totalCost = nbTotalCost;
+            totalCosts[nbNode] = nbTotalCost;
 
             // Store predecessor to recreate path
-            nbInfo.predecessor = current;
-
-            // Write back nbInfo
-            info[nbNode] = nbInfo;
+            predecessors[nbNode] = current;
 
-            const float nbHeuristic = heuristic(nodes[nbNode], destNode);
+#ifdef MULTI_GOAL
+            const float nbHeuristic =
+                HEURISTIC_WEIGHT * targets_heuristic(nodes, goals, targets, nodes[nbNode]);
+#else
+            const float nbHeuristic = HEURISTIC_WEIGHT * heuristic(nodes[nbNode], destNode);
+#endif
 
             if (nbIndex < open.size)
                 update(&open, nbIndex, nbNode, nbTotalCost + nbHeuristic);
@@ -263,9 +388,51 @@ __kernel void gpuAStar(__global const int2       *nodes,            // x, y
             // DEBUG: heap after push / update
             if (!is_heap(&open)) {
                 retCodeLength[GID] = (int2){91, 0};
+                WRITE_COUNTERS();
                 return; // error: broken heap!
             }
 #endif
         }
     }
+
+    WRITE_COUNTERS(); // no path found
+}
+
+// Runs after gpuAStar and an exclusive scan over its pathBytes. Writes all paths compacted into a
+// single buffer, so only the bytes actually used have to be downloaded.
+__kernel void encodePaths(__global const int2  *nodes,            // x, y
+                                   const ulong  nodesSize,
+                                   const ulong  numberOfAgents,
+                          __global const uint2 *srcDstList,       // source id, destination id
+                          __global const uint  *predecessorLists, // see gpuAStar
+                          __global const int2  *retCodeLength,    // see gpuAStar
+                          __global const uint  *pathOffsets,      // exclusive sums of pathBytes
+                          __global       uchar *paths             // encoded paths, see above
+#ifdef MULTI_GOAL
+                        , __global const uint  *reachedTargets    // see gpuAStar
+#endif
+                         )
+{
+    const size_t GID = get_global_id(0);
+
+    if (GID >= numberOfAgents || retCodeLength[GID].x != 0)
+        return;
+
+    __global const uint *predecessors = predecessorLists + GID * nodesSize;
+    __global      uchar *path         = paths + pathOffsets[GID];
+
+    for (uint i = pathOffsets[GID]; i < pathOffsets[GID + 1]; ++i)
+        paths[i] = 0;
+
+    // Walk backwards from destination, so the last move comes first.
+#ifdef MULTI_GOAL
+    uint node = reachedTargets[GID];
+#else
+    uint node = srcDstList[GID].y;
+#endif
+    for (uint move = retCodeLength[GID].y - 1; move > 0; --move) {
+        const uint predecessor = predecessors[node];
+        write_move(path, move - 1, move_direction(nodes[predecessor], nodes[node]));
+        node = predecessor;
+    }
 }
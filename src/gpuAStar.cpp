@@ -7,6 +7,8 @@
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <map>
+#include <mutex>
 #include <string>
 
 namespace {
@@ -18,11 +20,88 @@ std::string bytes(unsigned long long bytes) {
         return std::to_string(bytes >> 10) + " KBytes";
     return std::to_string(bytes) + " bytes";
 }
-} // namespace
 
-std::vector<std::vector<Node>>
-gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
-         const boost::compute::device &clDevice) {
+// Move directions as encoded by move_direction() in gpuAStar.cl
+const Position moves[8] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+const int      moveBits = 3;
+
+// OpenCL type of the per-node costs, see Graph::costData()
+std::string costType(int costBits) {
+    return costBits == 8 ? "uchar" : costBits == 16 ? "ushort" : "float";
+}
+
+// Open list entry: node, f-value
+using uint_float = std::pair<boost::compute::uint_, boost::compute::float_>;
+
+// Smallest open list in local memory per agent, the kernel reads the top from there.
+const std::size_t minLocalBytesPerAgent = 8 * sizeof(uint_float);
+
+// Launches found by calibrateGpuAStar() per device and map size class, shared by all calls
+std::mutex                                             launchMutex;
+std::map<std::pair<cl_device_id, int>, GpuAStarLaunch> calibratedLaunches;
+
+// Map size class: the number of nodes rounded up to a power of two, as exponent
+int sizeClass(const Graph &graph) {
+    int exponent = 0;
+    while ((1ll << exponent) < graph.size())
+        ++exponent;
+    return exponent;
+}
+
+// Guess for maps that have not been calibrated on the device: a small share of the map per agent
+// and as many agents per work-group as fit.
+GpuAStarLaunch defaultLaunch(const Graph &graph) {
+    GpuAStarLaunch launch;
+    launch.localBytesPerAgent = std::max(
+        minLocalBytesPerAgent, (std::size_t)(graph.size() * sizeof(uint_float) * 0.001));
+    launch.workGroupSize = std::numeric_limits<std::size_t>::max();
+    return launch;
+}
+
+GpuAStarLaunch calibratedLaunch(const Graph &graph, const boost::compute::device &clDevice) {
+    std::lock_guard<std::mutex> lock(launchMutex);
+    const auto it = calibratedLaunches.find({clDevice.id(), sizeClass(graph)});
+    return it != calibratedLaunches.end() ? it->second : defaultLaunch(graph);
+}
+
+// The kernel program for the graph, with the device side features of a search compiled in
+boost::compute::program buildProgram(const Graph &graph, const boost::compute::context &context,
+                                     float weight, int heapArity, bool goals, bool counters,
+                                     bool heatmap) {
+    auto program = boost::compute::program::create_with_source_file("src/gpuAStar.cl", context);
+    // Hint: Passing "-O0" somehow prevents compiler crash on AMD
+    program.build("-DCOST_T=" + costType(graph.costBits()) +
+                  " -DHEURISTIC_WEIGHT=" + std::to_string(weight) + "f" +
+                  " -DHEAP_ARITY=" + std::to_string(heapArity) + (goals ? " -DMULTI_GOAL" : "") +
+                  (counters ? " -DSEARCH_COUNTERS" : "") + (heatmap ? " -DEXPANSION_HEATMAP" : ""));
+    return program;
+}
+
+// Limit the launch to what the device and the kernel support. The work-group size is limited by
+// the resources the kernel needs, not only by the device.
+void limitLaunch(GpuAStarLaunch &launch, const boost::compute::device &clDevice,
+                 std::size_t kernelWorkGroupSize) {
+    const auto maxLocalBytes = (std::size_t)(clDevice.local_memory_size() * 0.99); // fails sometimes if you try to allocate 100%
+
+    launch.localBytesPerAgent =
+        std::min(std::max(launch.localBytesPerAgent, minLocalBytesPerAgent), maxLocalBytes) /
+        sizeof(uint_float) * sizeof(uint_float);
+    launch.workGroupSize = (std::size_t) 1 << (int) std::log2(std::min(
+        {launch.workGroupSize, maxLocalBytes / launch.localBytesPerAgent, kernelWorkGroupSize}));
+}
+
+// Starts and targets of the agents of gpuNearestAStar, see MULTI_GOAL in gpuAStar.cl
+struct AgentGoals {
+    std::vector<boost::compute::uint_>  nodes;  // ranges of starts and targets, concatenated
+    std::vector<boost::compute::uint4_> ranges; // per agent: starts begin, end, targets begin, end
+};
+
+// gpuAStar with the given launch, which is limited to what the device and kernel support and
+// updated to the values used. With goals, agents search from their starts to the nearest of
+// their targets instead of srcDstList, which then only gives the number of agents.
+PathSet search(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+               const boost::compute::device &clDevice, GpuSearchStats *stats, float weight,
+               GpuAStarLaunch &launch, const AgentGoals *goals = nullptr) {
     namespace compute = boost::compute;
 
     const auto numberOfAgents = srcDstList.size();
@@ -46,15 +125,20 @@ gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &s
 
     // Set up OpenCL environment and build program
     compute::context       context(clDevice);
-    compute::command_queue queue(context, clDevice);
+    compute::command_queue queue(context, clDevice,
+                                 stats ? compute::command_queue::enable_profiling : 0);
+
+    // Only for heatmaps of this graph, see Heatmap.h
+    Heatmap *heatmap = stats ? stats->heatmap : nullptr;
+    if (heatmap && (heatmap->width() != graph.width() || heatmap->height() != graph.height()))
+        heatmap = nullptr;
 
-    auto program = compute::program::create_with_source_file("src/gpuAStar.cl", context);
-    program.build(); // Hint: Passing "-O0" somehow prevents compiler crash on AMD
+    auto program = buildProgram(graph, context, weight, launch.heapArity, goals != nullptr,
+                                stats != nullptr, heatmap != nullptr);
 
     // Set up data structures on host
-    using uint_float = std::pair<compute::uint_, compute::float_>;
     std::vector<compute::int2_>  h_nodes;        // x, y
-    std::vector<uint_float>      h_edges;        // destination index, cost
+    std::vector<compute::uint_>  h_edges;        // destination index
     std::vector<compute::uint2_> h_adjacencyMap; // edges_begin, edges_end
     std::vector<compute::uint2_> h_srcDstList;   // source index, destination index
 
@@ -68,11 +152,10 @@ gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &s
             const Node current(graph, x, y);
             const auto begin = h_edges.size();
 
+            // Step costs are computed on the device from the per-node costs.
             for (const auto &neighbor : current.neighbors()) {
                 const auto &nbPosition = neighbor.first.position();
-                const float nbCost = neighbor.second;
-
-                h_edges.emplace_back(index(nbPosition.x, nbPosition.y), nbCost);
+                h_edges.push_back(index(nbPosition.x, nbPosition.y));
             }
 
             const auto end = h_edges.size();
@@ -90,35 +173,53 @@ gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &s
     }
 
     // Device memory
-    const std::size_t maxPathLength = 2 * (graph.width() + graph.height()); // TODO: correct size
     compute::vector<compute::int2_>  d_nodes(h_nodes.size(), context);
-    compute::vector<uint_float>      d_edges(h_edges.size(), context);
+    compute::vector<compute::uint_>  d_edges(h_edges.size(), context);
+    compute::buffer                  d_costs(context, graph.size() * graph.costBits() / 8);
     compute::vector<compute::uint2_> d_adjacencyMap(h_adjacencyMap.size(), context);
     compute::vector<compute::uint2_> d_srcDstList(h_srcDstList.size(), context);
-    compute::vector<compute::int2_>  d_paths(numberOfAgents * maxPathLength, context);
 
-    using Info = compute::uint4_; // wrong type, but should be a sufficient placeholder
+    // Encoded paths are compacted into one buffer, which is allocated once the size is known.
+    // One more element for the exclusive sums to get the total size as well.
+    compute::vector<compute::uint_> d_pathBytes(numberOfAgents + 1, context);
+    compute::vector<compute::uint_> d_pathOffsets(numberOfAgents + 1, context);
+
     static_assert(sizeof(compute::uint_) == sizeof(compute::float_), "Type size check failed!");
 
     // These should ideally be in local memory, but there is just not enough space!
-    compute::vector<uint_float> d_openExt(numberOfAgents * h_nodes.size(), context);
-    compute::vector<Info>       d_info(numberOfAgents * h_nodes.size(), context);
+    // Search state per agent as structure of arrays: closed bits, total costs, predecessors.
+    const std::size_t                closedSize = (h_nodes.size() + 31) / 32;
+    compute::vector<uint_float>      d_openExt(numberOfAgents * h_nodes.size(), context);
+    compute::vector<compute::uint_>  d_closed(numberOfAgents * closedSize, context);
+    compute::vector<compute::float_> d_totalCosts(numberOfAgents * h_nodes.size(), context);
+    compute::vector<compute::uint_>  d_predecessors(numberOfAgents * h_nodes.size(), context);
 
     // Not necessarily needed, but comfy
     compute::vector<compute::int2_> d_retCodeLength(numberOfAgents, context);
 
-    // Local memory: Some magic to find a good value for local memory size per agent.
-    const auto maxLocalBytes = (std::size_t)(clDevice.local_memory_size() * 0.99); // fails sometimes if you try to allocate 100%
-    const auto perAgentTargetBytes = std::max(7 * sizeof(uint_float), (std::size_t)(h_nodes.size() * sizeof(uint_float) * 0.001)); // really hard to pick a good factor here
-    const auto perAgentLocalBytes = std::min(perAgentTargetBytes, maxLocalBytes);
+    // Expanded nodes, pushes, pops, spills per agent
+    compute::vector<compute::uint4_> d_counters(stats ? numberOfAgents : 0, context);
+
+    // Expansions per node, summed over all agents
+    compute::vector<compute::uint_> d_heatmap(heatmap ? graph.size() : 0, context);
+
+    // Starts and targets of nearest goal queries, and the target each path leads to
+    compute::vector<compute::uint_>  d_goals(goals ? goals->nodes.size() : 0, context);
+    compute::vector<compute::uint4_> d_goalRanges(goals ? numberOfAgents : 0, context);
+    compute::vector<compute::uint_>  d_reachedTargets(goals ? numberOfAgents : 0, context);
+
+    compute::kernel kernel(program, "gpuAStar");
 
-    const auto localWorkSize =
-        std::min((std::size_t)(1 << (int) std::log2(maxLocalBytes / perAgentLocalBytes)),
-                 clDevice.get_info<CL_DEVICE_MAX_WORK_GROUP_SIZE>() / 2); // FIXME: /2 for notebook.
+    // Local memory: the open lists start in local memory and spill into d_openExt beyond
+    // launch.localBytesPerAgent, see calibrateGpuAStar().
+    limitLaunch(launch, clDevice,
+                kernel.get_work_group_info<std::size_t>(clDevice, CL_KERNEL_WORK_GROUP_SIZE));
+
+    const auto perAgentLocalBytes = launch.localBytesPerAgent;
+    const auto localWorkSize = launch.workGroupSize;
     const auto globalWorkSize =
         (std::size_t) std::ceil((double) numberOfAgents / localWorkSize) * localWorkSize;
 
-    // We *could* do a reevaluation of perAgentTargetBytes now that we've picked a localWorkSize.
     const auto localMemoryBytes = localWorkSize * perAgentLocalBytes;
     assert(localMemoryBytes <= clDevice.local_memory_size());
 
@@ -128,12 +229,15 @@ gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &s
 #ifdef DEBUG_OUTPUT
     std::cout << "Global memory used:"
               << "\n - Nodes: " << bytes(h_nodes.size() * sizeof(compute::int2_))
-              << "\n - Edges: " << bytes(h_edges.size() * sizeof(uint_float))
+              << "\n - Edges: " << bytes(h_edges.size() * sizeof(compute::uint_))
+              << "\n - Costs: " << bytes(d_costs.size())
               << "\n - Adjacency map: " << bytes(h_adjacencyMap.size() * sizeof(compute::uint2_))
               << "\n - SrcDst list: " << bytes(d_srcDstList.size() * sizeof(compute::uint2_))
-              << "\n - Paths: " << bytes(d_paths.size() * sizeof(compute::int2_))
+              << "\n - Path sizes: " << bytes(d_pathBytes.size() * sizeof(compute::uint_))
               << "\n - Open list (ext): " << bytes(d_openExt.size() * sizeof(uint_float))
-              << "\n - Info table: " << bytes(d_info.size() * sizeof(Info))
+              << "\n - Closed lists: " << bytes(d_closed.size() * sizeof(compute::uint_))
+              << "\n - Total costs: " << bytes(d_totalCosts.size() * sizeof(compute::float_))
+              << "\n - Predecessors: " << bytes(d_predecessors.size() * sizeof(compute::uint_))
               << "\nLocal memory used:"
               << "\n - Memory per agent: " << bytes(perAgentLocalBytes)
               << "\n - Local work size: " << localWorkSize
@@ -141,80 +245,309 @@ gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &s
               << std::endl;
 #endif
 
-    // Create kernel
-    compute::kernel kernel(program, "gpuAStar");
+    // Set kernel arguments
     kernel.set_arg(0, d_nodes);
     kernel.set_arg<compute::ulong_>(1, d_nodes.size());
     kernel.set_arg(2, d_edges);
     kernel.set_arg<compute::ulong_>(3, d_edges.size());
-    kernel.set_arg(4, d_adjacencyMap);
-    kernel.set_arg<compute::ulong_>(5, d_adjacencyMap.size());
-    kernel.set_arg<compute::ulong_>(6, numberOfAgents);
-    kernel.set_arg(7, d_srcDstList);
-    kernel.set_arg(8, d_paths);
-    kernel.set_arg<compute::ulong_>(9, maxPathLength);
-    kernel.set_arg(10, localMemory); // open list
-    kernel.set_arg<compute::ulong_>(11, localMemorySize / localWorkSize);
-    kernel.set_arg(12, d_openExt);
-    kernel.set_arg(13, d_info);
-    kernel.set_arg(14, d_retCodeLength);
-
-    // This initialization could be done by a kernel as well.
-    std::vector<Info> h_info(d_info.size(), {0, 0, 0, 0});
+    kernel.set_arg(4, d_costs);
+    kernel.set_arg<compute::float_>(5, graph.costScale());
+    kernel.set_arg(6, d_adjacencyMap);
+    kernel.set_arg<compute::ulong_>(7, d_adjacencyMap.size());
+    kernel.set_arg<compute::ulong_>(8, numberOfAgents);
+    kernel.set_arg(9, d_srcDstList);
+    kernel.set_arg(10, d_pathBytes);
+    kernel.set_arg(11, localMemory); // open list
+    kernel.set_arg<compute::ulong_>(12, localMemorySize / localWorkSize);
+    kernel.set_arg(13, d_openExt);
+    kernel.set_arg(14, d_closed);
+    kernel.set_arg(15, d_totalCosts);
+    kernel.set_arg(16, d_predecessors);
+    kernel.set_arg(17, d_retCodeLength);
+    std::size_t arg = 18;
+    if (goals) {
+        kernel.set_arg(arg++, d_goals);
+        kernel.set_arg(arg++, d_goalRanges);
+        kernel.set_arg(arg++, d_reachedTargets);
+    }
+    if (stats)
+        kernel.set_arg(arg++, d_counters);
+    if (heatmap)
+        kernel.set_arg(arg++, d_heatmap);
+
+    compute::kernel encodePaths(program, "encodePaths");
+    encodePaths.set_arg(0, d_nodes);
+    encodePaths.set_arg<compute::ulong_>(1, d_nodes.size());
+    encodePaths.set_arg<compute::ulong_>(2, numberOfAgents);
+    encodePaths.set_arg(3, d_srcDstList);
+    encodePaths.set_arg(4, d_predecessors);
+    encodePaths.set_arg(5, d_retCodeLength);
+    encodePaths.set_arg(6, d_pathOffsets);
+    if (goals)
+        encodePaths.set_arg(8, d_reachedTargets);
 
     // Upload data
     const auto uploadStart = std::chrono::high_resolution_clock::now();
     compute::copy(h_nodes.begin(), h_nodes.end(), d_nodes.begin(), queue);
     compute::copy(h_edges.begin(), h_edges.end(), d_edges.begin(), queue);
+    queue.enqueue_write_buffer(d_costs, 0, d_costs.size(), graph.costData());
     compute::copy(h_adjacencyMap.begin(), h_adjacencyMap.end(), d_adjacencyMap.begin(), queue);
     compute::copy(h_srcDstList.begin(), h_srcDstList.end(), d_srcDstList.begin(), queue);
-    compute::copy(h_info.begin(), h_info.end(), d_info.begin(), queue);
+    if (goals) {
+        compute::copy(goals->nodes.begin(), goals->nodes.end(), d_goals.begin(), queue);
+        compute::copy(goals->ranges.begin(), goals->ranges.end(), d_goalRanges.begin(), queue);
+    }
+    compute::fill(d_pathBytes.begin(), d_pathBytes.end(), 0, queue);
+    compute::fill(d_heatmap.begin(), d_heatmap.end(), 0, queue);
     const auto uploadStop = std::chrono::high_resolution_clock::now();
 
-    // Run kernel
-    const auto kernelStart = std::chrono::high_resolution_clock::now();
-    queue.enqueue_1d_range_kernel(kernel, 0, globalWorkSize, localWorkSize);
+    // Run kernels
+    const auto searchEvent =
+        queue.enqueue_1d_range_kernel(kernel, 0, globalWorkSize, localWorkSize);
+    compute::exclusive_scan(d_pathBytes.begin(), d_pathBytes.end(), d_pathOffsets.begin(), queue);
+
+    // The last exclusive sum is the total size of all encoded paths.
+    compute::uint_ pathDataSize = 0;
+    compute::copy(std::prev(d_pathOffsets.end()), d_pathOffsets.end(), &pathDataSize, queue);
+
+    compute::vector<compute::uchar_> d_paths(std::max<std::size_t>(pathDataSize, 1), context);
+    encodePaths.set_arg(7, d_paths);
+    const auto encodeEvent = queue.enqueue_1d_range_kernel(encodePaths, 0, globalWorkSize, 0);
     queue.finish();
-    const auto kernelStop = std::chrono::high_resolution_clock::now();
 
     // Download data
-    std::vector<compute::int2_> h_paths(d_paths.size()); // x, y
-    std::vector<compute::int2_> h_retCodeLength(d_retCodeLength.size());
+    std::vector<compute::uchar_> h_paths(pathDataSize); // encoded paths
+    std::vector<compute::uint_>  h_pathOffsets(d_pathOffsets.size());
+    std::vector<compute::int2_>  h_retCodeLength(d_retCodeLength.size());
+    std::vector<compute::uint_>  h_reachedTargets(d_reachedTargets.size());
 
     const auto downloadStart = std::chrono::high_resolution_clock::now();
-    compute::copy(d_paths.begin(), d_paths.end(), h_paths.begin(), queue);
+    compute::copy(d_paths.begin(), std::next(d_paths.begin(), pathDataSize), h_paths.begin(),
+                  queue);
+    compute::copy(d_pathOffsets.begin(), d_pathOffsets.end(), h_pathOffsets.begin(), queue);
     compute::copy(d_retCodeLength.begin(), d_retCodeLength.end(), h_retCodeLength.begin(), queue);
+    compute::copy(d_reachedTargets.begin(), d_reachedTargets.end(), h_reachedTargets.begin(),
+                  queue);
     const auto downloadStop = std::chrono::high_resolution_clock::now();
 
-    // Convert paths
-    std::vector<std::vector<Node>> paths(numberOfAgents);
+    if (stats) {
+        stats->uploadTime += uploadStop - uploadStart;
+        stats->downloadTime += downloadStop - downloadStart;
+        stats->kernels.emplace_back("gpuAStar", searchEvent);
+        stats->kernels.emplace_back("encodePaths", encodeEvent);
+
+        std::vector<compute::uint4_> h_counters(d_counters.size());
+        compute::copy(d_counters.begin(), d_counters.end(), h_counters.begin(), queue);
+        for (const auto &counters : h_counters) {
+            stats->expanded += counters[0];
+            stats->pushes += counters[1];
+            stats->pops += counters[2];
+            stats->spills += counters[3];
+        }
+    }
+
+    if (heatmap) {
+        std::vector<compute::uint_> h_heatmap(d_heatmap.size());
+        compute::copy(d_heatmap.begin(), d_heatmap.end(), h_heatmap.begin(), queue);
+        heatmap->add(h_heatmap);
+    }
+
+    // Decode paths straight into the result, moves become offsets between cell indices.
+    std::size_t cellCount = 0;
+    for (const auto &retCodeLength : h_retCodeLength)
+        if (retCodeLength[0] == 0)
+            cellCount += retCodeLength[1];
+
+    PathSet::Cell steps[8];
+    for (int move = 0; move < 8; ++move)
+        steps[move] = (PathSet::Cell)(moves[move].y * graph.width() + moves[move].x);
+
+    PathSet paths(graph.width());
+    paths.reserve(numberOfAgents, cellCount);
     for (std::size_t i = 0; i < numberOfAgents; ++i) {
         const int returnCode = h_retCodeLength[i][0];
         const int pathLength = h_retCodeLength[i][1];
 
-        if (returnCode != 0)
+        if (returnCode != 0) {
+            paths.append(0, PathSet::NoPath);
             continue;
+        }
 
-        paths[i].reserve(pathLength);
-        const auto begin = std::next(h_paths.begin(), i * maxPathLength);
-        const auto end = std::next(begin, pathLength);
+        const auto *data = h_paths.data() + h_pathOffsets[i];
+        const auto  dataSize = h_pathOffsets[i + 1] - h_pathOffsets[i];
 
-        std::transform(begin, end, std::back_inserter(paths[i]),
-                       [&](compute::int2_ node) { return Node(graph, node[0], node[1]); });
+        // Backwards from the end, the start of nearest goal queries is only known to the device.
+        auto *cells = paths.append(pathLength, PathSet::Found);
+        cells[pathLength - 1] = goals ? h_reachedTargets[i] : h_srcDstList[i][1];
+
+        for (int move = pathLength - 2; move >= 0; --move) {
+            const auto bit = move * moveBits;
+            const auto byte = (std::size_t) bit / 8;
+
+            unsigned int bits = data[byte];
+            if (byte + 1 < dataSize)
+                bits |= data[byte + 1] << 8;
+
+            // Unsigned wrap-around takes care of negative steps.
+            cells[move] = cells[move + 1] - steps[(bits >> (bit % 8)) & 0x7];
+        }
 
-        // Path is in inverse order. Reverse it.
-        std::reverse(paths[i].begin(), paths[i].end());
+        assert(goals || cells[0] == h_srcDstList[i][0]);
     }
 
-    // Print timings
-    std::cout << "GPU time for " << numberOfAgents << " runs:"
-              << "\n - Upload time: "
-              << std::chrono::duration<double>(uploadStop - uploadStart).count() << " seconds"
-              << "\n - Kernel runtime: "
-              << std::chrono::duration<double>(kernelStop - kernelStart).count() << " seconds"
-              << "\n - Download time: "
-              << std::chrono::duration<double>(downloadStop - downloadStart).count() << " seconds"
-              << std::endl;
+    return paths;
+}
+} // namespace
+
+PathSet
+gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+         const boost::compute::device &clDevice, GpuSearchStats *stats, float weight,
+         PathCache *cache) {
+    auto launch = calibratedLaunch(graph, clDevice);
+
+    // Queries between components are answered without an agent, which would exhaust the
+    // component of its source. Duplicates share one agent.
+    return searchUnique(graph, srcDstList, weight, cache,
+                        [&](const std::vector<std::pair<Position, Position>> &searched) {
+                            if (stats)
+                                stats->agents += searched.size();
+                            return search(graph, searched, clDevice, stats, weight, launch);
+                        });
+}
+
+PathSet gpuNearestAStar(const Graph &graph, const std::vector<GoalQuery> &queries,
+                        const boost::compute::device &clDevice, GpuSearchStats *stats) {
+    namespace compute = boost::compute;
 
+    auto launch = calibratedLaunch(graph, clDevice);
+
+    const int width = graph.width();
+    auto      index = [width](const Position &p) { return (compute::uint_)(p.y * width + p.x); };
+
+    // Like in cpuNearestAStar, many goals are searched from all of them towards the source. The
+    // agents of a work-group run in lockstep, so the loops over the targets cost more than on the
+    // CPU.
+    const std::size_t maxHeuristicGoals = 4;
+
+    AgentGoals                                 goals;
+    std::vector<std::pair<Position, Position>> agents;   // the source twice, see search()
+    std::vector<std::size_t>                   agentOf;  // per query, SIZE_MAX without agent
+    std::vector<char>                          reversed; // per agent: path from the source back
+    for (const auto &query : queries) {
+        const auto source = index(query.first);
+
+        // Goals outside the component of the source would never be reached.
+        std::vector<compute::uint_> targets;
+        for (const auto &goal : query.second)
+            if (graph.connected((int) source, (int) index(goal)))
+                targets.push_back(index(goal));
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+        if (targets.empty()) {
+            agentOf.push_back(SIZE_MAX);
+            continue;
+        }
+        agentOf.push_back(agents.size());
+        agents.emplace_back(query.first, query.first);
+        reversed.push_back(targets.size() > maxHeuristicGoals);
+
+        const auto begin = (compute::uint_) goals.nodes.size();
+        const auto count = (compute::uint_) targets.size();
+        if (reversed.back()) {
+            goals.nodes.insert(goals.nodes.end(), targets.begin(), targets.end());
+            goals.nodes.push_back(source);
+            goals.ranges.emplace_back(begin, begin + count, begin + count, begin + count + 1);
+        } else {
+            goals.nodes.push_back(source);
+            goals.nodes.insert(goals.nodes.end(), targets.begin(), targets.end());
+            goals.ranges.emplace_back(begin, begin + 1, begin + 1, begin + 1 + count);
+        }
+    }
+
+    PathSet found(width);
+    if (!agents.empty())
+        found = search(graph, agents, clDevice, stats, 1.0f, launch, &goals);
+    if (stats)
+        stats->agents += agents.size();
+
+    PathSet paths(width);
+    paths.reserve(queries.size(), found.cells().size());
+    for (const auto agent : agentOf) {
+        if (agent == SIZE_MAX) {
+            paths.append(0, PathSet::NoPath);
+            continue;
+        }
+
+        // Paths of reversed agents lead from the nearest goal to the source. Graph::pathCost()
+        // is symmetric, so reversed they are the paths searched for.
+        const auto path = found[agent];
+        auto *     cells = paths.append(path.size(), found.status(agent));
+        if (reversed[agent])
+            std::reverse_copy(path.begin(), path.end(), cells);
+        else
+            std::copy(path.begin(), path.end(), cells);
+    }
     return paths;
 }
+
+GpuAStarLaunch
+calibrateGpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &sampleList,
+                  const boost::compute::device &clDevice, int heapArity) {
+    // Candidates: local memory per agent in powers of two, with as many agents per work-group as
+    // fit, half as many, or a quarter. Fewer agents leave more room for other work-groups.
+    const auto maxLocalBytes = (std::size_t)(clDevice.local_memory_size() * 0.99);
+
+    // Candidates are limited like in search() before they run, so those that end up alike run
+    // only once. The kernel is built as for the sample searches, with counters.
+    const boost::compute::context context(clDevice);
+    const auto kernelWorkGroupSize =
+        boost::compute::kernel(buildProgram(graph, context, 1.0f, heapArity, false, true, false),
+                               "gpuAStar")
+            .get_work_group_info<std::size_t>(clDevice, CL_KERNEL_WORK_GROUP_SIZE);
+
+    std::vector<GpuAStarLaunch> tried;
+    GpuAStarLaunch              best;
+    for (auto localBytes = minLocalBytesPerAgent; localBytes <= maxLocalBytes; localBytes *= 2) {
+        for (int shift = 0; shift < 3 && (maxLocalBytes / localBytes) >> shift; ++shift) {
+            GpuAStarLaunch launch;
+            launch.localBytesPerAgent = localBytes;
+            launch.workGroupSize = (maxLocalBytes / localBytes) >> shift;
+            launch.heapArity = heapArity;
+            limitLaunch(launch, clDevice, kernelWorkGroupSize);
+
+            // Limited by the kernel, the same as an earlier candidate
+            if (std::any_of(tried.begin(), tried.end(), [&](const GpuAStarLaunch &other) {
+                    return other.localBytesPerAgent == launch.localBytesPerAgent &&
+                           other.workGroupSize == launch.workGroupSize;
+                }))
+                continue;
+
+            GpuSearchStats stats;
+            search(graph, sampleList, clDevice, &stats, 1.0f, launch);
+
+            double seconds = 0.0;
+            for (const auto &kernel : stats.kernels)
+                if (kernel.name == "gpuAStar")
+                    seconds += (kernel.end - kernel.start) * 1e-9;
+
+            launch.spills = stats.spills;
+            launch.agentsPerSecond = sampleList.size() / std::max(seconds, 1e-9);
+            tried.push_back(launch);
+
+#ifdef DEBUG_OUTPUT
+            std::cout << "Calibration: " << bytes(launch.localBytesPerAgent) << " per agent, "
+                      << launch.workGroupSize << " per work-group: " << launch.spills
+                      << " spills, " << launch.agentsPerSecond << " agents per second"
+                      << std::endl;
+#endif
+
+            if (launch.agentsPerSecond > best.agentsPerSecond)
+                best = launch;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(launchMutex);
+    calibratedLaunches[{clDevice.id(), sizeClass(graph)}] = best;
+    return best;
+}
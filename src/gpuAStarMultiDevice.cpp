@@ -0,0 +1,154 @@
+#include "astar.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <numeric>
+
+namespace {
+// Measured batch throughput (agents per second) of each device, shared by all calls
+std::mutex                     throughputMutex;
+std::map<cl_device_id, double> throughputs;
+
+// Guess for devices that have not run a batch yet. Only the ratio between devices matters.
+double estimatedThroughput(const boost::compute::device &clDevice) {
+    return (double) clDevice.compute_units() * clDevice.clock_frequency();
+}
+
+// Split count agents into one contiguous chunk per device, proportional to the weights.
+std::vector<std::size_t> chunkSizes(std::size_t count, const std::vector<double> &weights) {
+    const auto totalWeight = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+    std::vector<std::size_t> sizes(weights.size());
+    std::size_t              assigned = 0;
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+        sizes[i] = (std::size_t)(count * weights[i] / totalWeight);
+        assigned += sizes[i];
+    }
+
+    // Rounding leftovers go to the fastest device
+    const auto fastest = std::max_element(weights.begin(), weights.end()) - weights.begin();
+    sizes[fastest] += count - assigned;
+
+    return sizes;
+}
+
+// Search the batch on all devices, in chunks proportional to their throughput
+PathSet split(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+              const std::vector<boost::compute::device> &clDevices, GpuSearchStats *stats,
+              float weight) {
+    // Measured throughputs where there are any. The estimates of the other devices are scaled by
+    // how the measured devices compare to their own estimates, to stay comparable.
+    std::vector<double> weights;
+    std::vector<bool>   measured;
+    {
+        std::lock_guard<std::mutex> lock(throughputMutex);
+        double                      measuredSum = 0.0, estimatedSum = 0.0;
+        for (const auto &clDevice : clDevices) {
+            const auto it = throughputs.find(clDevice.id());
+            if (it != throughputs.end()) {
+                measuredSum += it->second;
+                estimatedSum += estimatedThroughput(clDevice);
+            }
+        }
+        const double scale = estimatedSum > 0.0 ? measuredSum / estimatedSum : 1.0;
+
+        for (const auto &clDevice : clDevices) {
+            const auto it = throughputs.find(clDevice.id());
+            measured.push_back(it != throughputs.end());
+            weights.push_back(measured.back() ? it->second
+                                              : scale * estimatedThroughput(clDevice));
+        }
+    }
+
+    auto sizes = chunkSizes(srcDstList.size(), weights);
+
+    // Only a device that runs a chunk gets measured, so every other one gets at least one agent.
+    for (std::size_t i = 0; i < clDevices.size(); ++i) {
+        const auto largest = std::max_element(sizes.begin(), sizes.end());
+        if (!measured[i] && sizes[i] == 0 && *largest > 1) {
+            --*largest;
+            ++sizes[i];
+        }
+    }
+
+    // Every device gets its own context, graph upload and chunk, run from its own thread.
+    std::vector<GpuSearchStats>       deviceStats(clDevices.size());
+    std::vector<Heatmap>              deviceHeatmaps; // merged afterwards, see Heatmap.h
+    if (stats && stats->heatmap && stats->heatmap->width() == graph.width() &&
+        stats->heatmap->height() == graph.height()) {
+        deviceHeatmaps.assign(clDevices.size(), Heatmap(graph.width(), graph.height()));
+        for (std::size_t i = 0; i < clDevices.size(); ++i)
+            deviceStats[i].heatmap = &deviceHeatmaps[i];
+    }
+    std::vector<std::future<PathSet>> results;
+
+    auto chunkBegin = srcDstList.begin();
+    for (std::size_t i = 0; i < clDevices.size(); ++i) {
+        const auto chunkEnd = std::next(chunkBegin, sizes[i]);
+        results.push_back(std::async(
+            std::launch::async,
+            [&, i](std::vector<std::pair<Position, Position>> chunk) {
+                PathSet paths(graph.width());
+                if (chunk.empty())
+                    return paths;
+
+                const auto start = std::chrono::high_resolution_clock::now();
+                paths = gpuAStar(graph, chunk, clDevices[i], stats ? &deviceStats[i] : nullptr,
+                                 weight);
+                const auto stop = std::chrono::high_resolution_clock::now();
+
+                // Smooth the measurement, batches differ in difficulty.
+                const auto throughput =
+                    chunk.size() / std::chrono::duration<double>(stop - start).count();
+                std::lock_guard<std::mutex> lock(throughputMutex);
+                auto it = throughputs.find(clDevices[i].id());
+                if (it == throughputs.end())
+                    throughputs.emplace(clDevices[i].id(), throughput);
+                else
+                    it->second = 0.5 * it->second + 0.5 * throughput;
+
+                return paths;
+            },
+            std::vector<std::pair<Position, Position>>(chunkBegin, chunkEnd)));
+        chunkBegin = chunkEnd;
+    }
+
+    // Merge results back in the original order
+    PathSet paths(graph.width());
+    for (std::size_t i = 0; i < clDevices.size(); ++i) {
+        paths.append(results[i].get());
+
+        if (stats) {
+            // Tell the kernels of the different devices apart
+            for (auto &kernel : deviceStats[i].kernels)
+                kernel.name = clDevices[i].name() + ": " + kernel.name;
+            *stats += deviceStats[i];
+            if (!deviceHeatmaps.empty())
+                stats->heatmap->add(deviceHeatmaps[i].counts());
+        }
+    }
+
+    return paths;
+}
+} // namespace
+
+PathSet
+gpuAStar(const Graph &graph, const std::vector<std::pair<Position, Position>> &srcDstList,
+         const std::vector<boost::compute::device> &clDevices, GpuSearchStats *stats, float weight,
+         PathCache *cache) {
+    assert(!clDevices.empty());
+
+    if (clDevices.size() == 1)
+        return gpuAStar(graph, srcDstList, clDevices.front(), stats, weight, cache);
+
+    // Deduplicate before splitting, so that every device gets only unique queries.
+    return searchUnique(graph, srcDstList, weight, cache,
+                        [&](const std::vector<std::pair<Position, Position>> &searched) {
+                            return split(graph, searched, clDevices, stats, weight);
+                        });
+}
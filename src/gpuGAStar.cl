@@ -6,18 +6,32 @@
 
 #define SQRT2 1.41421356237f
 
+#ifndef COST_T
+#define COST_T float // per-node cost storage, see Graph::quantizeCosts()
+#endif
+
+#ifndef HEURISTIC_WEIGHT
+#define HEURISTIC_WEIGHT 1.0f // weighted A* above 1, paths cost at most this times the optimum
+#endif
+
+#ifndef HEAP_ARITY
+#define HEAP_ARITY 2 // children per open list node, wider heaps are shallower
+#endif
+
 // ----- Types ----------------------------------------------------------------
 typedef struct {
     uint  first;
     float second;
 } uint_float;
 
-typedef struct {  // Depending on use case...
-    uint  closed; // only one of the first two members is used here
-    uint  node;   // the other one gives padding for memory alignment
+typedef struct {  // "S" and "T" list entries
+    uint  node;
     float totalCost;
     uint  predecessor;
-} Info;
+} Successor;
+
+// Per-node search state is kept as structure of arrays: one bit per node for the closed list, a
+// separate array for the total costs and one for the predecessors.
 
 // ----- Helper ---------------------------------------------------------------
 uint_float _read_heap(__global uint_float *open, size_t index) {
@@ -28,6 +42,15 @@ void _write_heap(__global uint_float *open, size_t index, uint_float value) {
     open[index] = value;
 }
 
+// ----- Closed list functions ------------------------------------------------
+bool is_closed(__global const uint *closed, uint node) {
+    return (closed[node / 32] >> (node % 32)) & 1;
+}
+
+void set_closed(__global uint *closed, uint node) {
+    atomic_or(closed + node / 32, 1u << (node % 32));
+}
+
 // ----- OpenList functions ---------------------------------------------------
 uint top(__global uint_float *open) {
     return open[0].first;
@@ -37,7 +60,7 @@ void push(__global uint_float *open, size_t *size, uint value, float cost) {
     size_t index = (*size)++;
 
     while (index > 0) {
-        size_t parent = (index - 1) / 2;
+        size_t parent = (index - 1) / HEAP_ARITY;
 
         uint_float pValue = _read_heap(open, parent);
         if (cost < pValue.second) {
@@ -54,16 +77,19 @@ void pop(__global uint_float *open, size_t *size) {
     uint_float value = _read_heap(open, --(*size));
     size_t     index = 0;
 
-    while (index < *size / 2) {
-        size_t child = index * 2 + 1;
+    while (index * HEAP_ARITY + 1 < *size) {
+        size_t first = index * HEAP_ARITY + 1;
+        size_t last  = first + HEAP_ARITY < *size ? first + HEAP_ARITY : *size;
+        size_t child = first;
 
+        // Cheapest child, all of them lie next to each other
         uint_float cValue = _read_heap(open, child);
-        if (child + 1 < *size) {
-            uint_float c1Value = _read_heap(open, child + 1);
+        for (size_t other = first + 1; other < last; ++other) {
+            uint_float oValue = _read_heap(open, other);
 
-            if (c1Value.second < cValue.second) {
-                ++child;
-                cValue = c1Value;
+            if (oValue.second < cValue.second) {
+                child = other;
+                cValue = oValue;
             }
         }
 
@@ -77,14 +103,31 @@ void pop(__global uint_float *open, size_t *size) {
     _write_heap(open, index, value);
 }
 
+// ----- Costs ----------------------------------------------------------------
+// Same as Graph::pathCost(). Costs are stored per node, scaled by costScale.
+float step_cost(__global const int2   *nodes,
+                __global const COST_T *costs,
+                         const float   costScale,
+                               uint    source,
+                               uint    destination)
+{
+    const float cost = max(costs[source], costs[destination]) * costScale;
+    const int2  src  = nodes[source];
+    const int2  dst  = nodes[destination];
+    return src.x != dst.x && src.y != dst.y ? SQRT2 * cost : cost;
+}
+
 // ----- Kernels --------------------------------------------------------------
 __kernel void clearList(__global uint *list, const ulong size) {
     if (get_global_id(0) < size)
         list[get_global_id(0)] = 0;
 }
 
-__kernel void extractAndExpand(__global const uint_float *edges,            // destination index, stepCost
+__kernel void extractAndExpand(__global const int2       *nodes,            // x, y
+                               __global const uint       *edges,            // destination index
                                         const ulong       edgesSize,
+                               __global const COST_T     *costs,            // per node
+                                        const float       costScale,
                                __global const uint2      *adjacencyMap,     // edges_begin, edges_end
                                         const ulong       adjacencyMapSize,
                                         const ulong       numberOfQueues,   // provides offset ...
@@ -92,11 +135,19 @@ __kernel void extractAndExpand(__global const uint_float *edges,            // d
                                         const uint        destination,      // destination index
                                __global       uint_float *openLists,        // aka "Q" priority queues
                                __global       uint       *openSizes,
-                               __global       Info       *info,             // closed list, see members at the top
-                               __global       Info       *slistChunks,      // "S" list, divided into chunks
+                               __global const float      *totalCosts,       // g-values
+                               __global       Successor  *slistChunks,      // "S" list, divided into chunks
                                __global       uint       *slistSizes,
                                         const ulong       slistChunkSize,
-                               __global       uint       *returnCode)
+                               __global       uint       *returnCode,
+                               __global       uint       *bestCost          // of the destination, as float bits
+#ifdef SEARCH_COUNTERS
+                             , __global       uint4      *counters          // expanded, pushes, pops, spills
+#endif
+#ifdef EXPANSION_HEATMAP
+                             , __global       uint       *heatmap           // expansions per node, all queues
+#endif
+                              )
 {
     // Parallel for each queue (one dimensional)
     const size_t GID = get_global_id(0);
@@ -105,35 +156,48 @@ __kernel void extractAndExpand(__global const uint_float *edges,            // d
         return;
 
     __global uint_float *openList = openLists + GID * sizeOfAQueue;
-    __global Info       *slist = slistChunks + GID * slistChunkSize;
+    __global Successor  *slist = slistChunks + GID * slistChunkSize;
 
     size_t openSize = openSizes[GID]; // read open list size
     uint   slistSize = 0;
 
-    if (openSize == 0) {
-        atomic_min(returnCode, 2);
-        return; // failure: no path found!
-    }
+    // Nothing left in this queue that could lead to a cheaper path. The search is over when this
+    // holds for all queues, see returnCode in the host code.
+    if (openSize == 0 || openList[0].second >= as_float(*bestCost))
+        return;
 
     const uint current = top(openList);
     pop(openList, &openSize);
+#ifdef SEARCH_COUNTERS
+    ++counters[GID].z;
+#endif
 
     if (current == destination) {
-        atomic_min(returnCode, 0);
-        return; // success: path found!
+        // Non-negative floats compare like their bits as uint.
+        atomic_min(bestCost, as_uint(totalCosts[destination]));
+        openSizes[GID] = (uint) openSize;
+        atomic_min(returnCode, 1); // still running, other queues may hold cheaper paths
+        return;
     }
 
+#ifdef SEARCH_COUNTERS
+    ++counters[GID].x;
+#endif
+#ifdef EXPANSION_HEATMAP
+    atomic_inc(heatmap + current);
+#endif
+
     // In this algorithm, "closed" means already added to open list.
     // --> nothing to do here.
-    const Info currentInfo = info[current];
+    const float totalCost = totalCosts[current];
 
     const uint2 edgeRange = adjacencyMap[current];
     for (uint edge = edgeRange.x; edge != edgeRange.y; ++edge) {
-        const uint  nbNode     = edges[edge].first;
-        const float nbStepCost = edges[edge].second;
+        const uint  nbNode     = edges[edge];
+        const float nbStepCost = step_cost(nodes, costs, costScale, current, nbNode);
 
-        const float nbTotalCost = currentInfo.totalCost + nbStepCost;
-        slist[slistSize++] = (Info){0, nbNode, nbTotalCost, current};
+        const float nbTotalCost = totalCost + nbStepCost;
+        slist[slistSize++] = (Successor){nbNode, nbTotalCost, current};
     }
 
     // Write back new list sizes
@@ -143,15 +207,46 @@ __kernel void extractAndExpand(__global const uint_float *edges,            // d
     atomic_min(returnCode, 1); // still running...
 }
 
+// Successors of one round may reach the same node from several queues. Only the cheapest of them
+// passes duplicate detection, so computeAndPushBack() updates every node from a single work-item:
+// its cost and predecessor always come from the same path, and only ever decrease.
+__kernel void cheapestSuccessors(         const ulong       numberOfQueues,   // provides offset ...
+                                 __global const uint       *closed,           // one bit per node
+                                 __global const float      *totalCosts,       // g-values
+                                 __global const Successor  *slistChunks,      // "S" list, divided into chunks
+                                 __global const uint       *slistSizes,
+                                          const ulong       slistChunkSize,
+                                 __global       uint       *roundCosts)       // per node, as float bits
+{
+    // Parallel for each element in S-list (two dimensional)
+    const uint2 GID = {get_global_id(0), get_global_id(1)};
+
+    if (GID.x >= numberOfQueues || GID.y >= slistChunkSize)
+        return;
+
+    __global const Successor *slist = slistChunks + GID.x * slistChunkSize;
+    if (GID.y >= slistSizes[GID.x])
+        return;
+
+    const Successor current = slist[GID.y];
+
+    // In this algorithm, "closed" means already added to open list. Only successors that improve
+    // on the known cost pass, so a cheaper path to a node is never dropped.
+    if (is_closed(closed, current.node) && totalCosts[current.node] <= current.totalCost)
+        return; // equal or better candidate already in open list
+
+    // Non-negative floats compare like their bits as uint.
+    atomic_min(roundCosts + current.node, as_uint(current.totalCost));
+}
+
 __kernel void duplicateDetection(         const ulong       numberOfQueues,   // provides offset ...
-                                 __global       Info       *info,             // closed list, see members at the top
-                                 __global       Info       *slistChunks,      // "S" list, divided into chunks
+                                 __global const uint       *roundCosts,       // see cheapestSuccessors
+                                 __global       uint       *roundClaims,      // per node, set once taken
+                                 __global       Successor  *slistChunks,      // "S" list, divided into chunks
                                  __global       uint       *slistSizes,
                                           const ulong       slistChunkSize,   // equals "tlistChunkSize" as well
-                                 __global       Info       *tlistChunks,      // "T" list, divided into chunks
-                                 __global       uint       *tlistSizes,
-                                 __global       uint       *hashTable,
-                                          const ulong       hashTableSize)
+                                 __global       Successor  *tlistChunks,      // "T" list, divided into chunks
+                                 __global       uint       *tlistSizes)
 {
     // Parallel for each element in S-list (two dimensional)
     const uint2 GID = {get_global_id(0), get_global_id(1)};
@@ -159,40 +254,34 @@ __kernel void duplicateDetection(         const ulong       numberOfQueues,   //
     if (GID.x >= numberOfQueues || GID.y >= slistChunkSize)
         return;
 
-    __global Info *slist = slistChunks + GID.x * slistChunkSize;
+    __global Successor *slist = slistChunks + GID.x * slistChunkSize;
     uint slistSize = slistSizes[GID.x];
 
     if (GID.y >= slistSize)
         return;
 
-    const Info current = slist[GID.y];
-    const Info nodeInfo = info[current.node];
-
-    // In this algorithm, "closed" means already added to open list.
-    if (nodeInfo.closed == 1 && nodeInfo.totalCost < current.totalCost)
-        return; // better candidate already in open list
-
-    // Dedublication with hashing
-    const uint hash = current.node % hashTableSize; // TODO: size +/- 1 for better collisions ?
-    const uint old = atomic_xchg(hashTable + hash, current.node);
+    const Successor current = slist[GID.y];
 
-    if (old == current.node)
-        return; // node has already been added
-
-    // TODO: There is some searching in the script. Should we add that? I don't see the point...
+    // Not the cheapest successor of its node in this round, or an equally cheap one was taken
+    // already. Dropped successors did not pass cheapestSuccessors, so they cost more anyway.
+    if (as_uint(current.totalCost) != roundCosts[current.node] ||
+        atomic_xchg(roundClaims + current.node, 1) != 0)
+        return;
 
-    __global Info *tlist = tlistChunks + GID.x * slistChunkSize;
+    __global Successor *tlist = tlistChunks + GID.x * slistChunkSize;
     const uint index = atomic_inc(tlistSizes + GID.x);
     tlist[index] = current;
 }
 
 __kernel void compactTList(         const ulong       numberOfQueues,   // provides offset ...
-                           __global const Info       *tlistChunks,      // "T" list, divided into chunks
+                           __global const Successor  *tlistChunks,      // "T" list, divided into chunks
                            __global const uint       *tlistSizes,
                                     const ulong       tlistChunkSize,
                            __global       uint       *exclusiveSums,
-                           __global       Info       *tlistCompacted,
-                           __global       uint       *tlistCompactedSize)
+                           __global       Successor  *tlistCompacted,
+                           __global       uint       *tlistCompactedSize,
+                           __global       uint       *roundCosts,       // reset for the next round
+                           __global       uint       *roundClaims)
 {
     // Parallel for each element in T-list (two dimensional)
     const uint2 GID = {get_global_id(0), get_global_id(1)};
@@ -200,7 +289,7 @@ __kernel void compactTList(         const ulong       numberOfQueues,   // provi
     if (GID.x >= numberOfQueues || GID.y >= tlistChunkSize)
         return;
 
-    __global const Info *tlist = tlistChunks + GID.x * tlistChunkSize;
+    __global const Successor *tlist = tlistChunks + GID.x * tlistChunkSize;
     const uint tlistSize = tlistSizes[GID.x];
     const uint index = exclusiveSums[GID.x];
 
@@ -211,7 +300,12 @@ __kernel void compactTList(         const ulong       numberOfQueues,   // provi
     if (GID.y >= tlistSize)
         return;
 
-    tlistCompacted[index + GID.y] = tlist[GID.y];
+    // Every node with a successor in this round has exactly one in the T list.
+    const Successor current = tlist[GID.y];
+    roundCosts[current.node]  = as_uint(INFINITY);
+    roundClaims[current.node] = 0;
+
+    tlistCompacted[index + GID.y] = current;
 }
 
 // http://theory.stanford.edu/~amitp/GameProgramming/Heuristics.html#diagonal-distance
@@ -228,10 +322,16 @@ __kernel void computeAndPushBack(__global const int2       *nodes,            //
                                           const uint        destination,      // destination index
                                  __global       uint_float *openLists,        // aka "Q" priority queues
                                  __global       uint       *openSizes,
-                                 __global       Info       *info,             // closed list, see members at the top
-                                 __global const Info       *tlistCompacted,   // "T" list, compacted!
+                                 __global       uint       *closed,           // one bit per node
+                                 __global       float      *totalCosts,       // g-values
+                                 __global       uint       *predecessors,     // to recreate path
+                                 __global const Successor  *tlistCompacted,   // "T" list, compacted!
                                  __global const uint       *tlistCompactedSize,
-                                 __global const uint       *queueRotation)
+                                 __global const uint       *queueRotation
+#ifdef SEARCH_COUNTERS
+                               , __global       uint4      *counters          // expanded, pushes, pops, spills
+#endif
+                                )
 {
     // Parallel for each queue (one dimensional)
     const size_t GID = get_global_id(0);
@@ -252,44 +352,89 @@ __kernel void computeAndPushBack(__global const int2       *nodes,            //
         if (openSize == sizeOfAQueue)
             break;
 
-        const Info current = tlistCompacted[i];
-
-#if 0
-        // Replaced: This idea doesn't seem to work for some reason...
+        const Successor current = tlistCompacted[i];
 
-        // In this algorithm, "closed" means already added to open list.
-        info[current.node].closed = 1; // close node
-        
-        // Update totalCost and predecessor as one 64 bit transaction.
-        ulong *currentCostPred = (ulong *) &current.totalCost;
-        __global ulong *infoCostPred = (__global ulong *) &info[current.node].totalCost;
-        ulong oldCostPred = atom_xchg(infoCostPred, *currentCostPred);
-        float *oldCost = (float *) &oldCostPred;
-
-        // assert: current.totalCost > 0.0f
-        while (*oldCost != 0.0f && *oldCost < current.totalCost) {
-            // The old entry was better. Swap back!
-            *currentCostPred = oldCostPred;
-            oldCostPred = atom_xchg(infoCostPred, *currentCostPred);
-        }
-#else
-        // FIXME: There is still a bug here, a data race on duplicate nodes!
-        Info nodeInfo = info[current.node];
-        if (nodeInfo.totalCost == 0.0f || current.totalCost < nodeInfo.totalCost) {
-            nodeInfo.totalCost = current.totalCost;
-            nodeInfo.predecessor = current.predecessor;
+        // The only successor of its node in this round, see cheapestSuccessors
+        const float nodeCost = totalCosts[current.node];
+        if (nodeCost == 0.0f || current.totalCost < nodeCost) {
+            totalCosts[current.node]   = current.totalCost;
+            predecessors[current.node] = current.predecessor;
         }
 
         // In this algorithm, "closed" means already added to open list.
-        nodeInfo.closed = 1; // close node
-
-        info[current.node] = nodeInfo; // write back
-#endif
+        set_closed(closed, current.node);
 
-        float h = heuristic(nodes[current.node], destNode);
+        float h = HEURISTIC_WEIGHT * heuristic(nodes[current.node], destNode);
         push(openList, &openSize, current.node, current.totalCost + h);
     }
 
+#ifdef SEARCH_COUNTERS
+    counters[GID].y += (uint) openSize - openSizes[openIndex];
+#endif
+
     // Write back new list size
     openSizes[openIndex] = (uint) openSize;
 }
+
+// ----- Heatmap --------------------------------------------------------------
+// Copies the nodes of all open lists into one buffer, at the exclusive sums of the list sizes.
+__kernel void snapshotFrontier(         const ulong       numberOfQueues,   // provides offset ...
+                                        const ulong       sizeOfAQueue,     // provides offset ...
+                               __global const uint_float *openLists,        // aka "Q" priority queues
+                               __global const uint       *openSizes,
+                               __global const uint       *frontierOffsets,  // exclusive sums of openSizes
+                               __global       uint       *frontier)         // node indices
+{
+    // Parallel for each queue (one dimensional)
+    const size_t GID = get_global_id(0);
+
+    if (GID >= numberOfQueues)
+        return;
+
+    __global const uint_float *openList = openLists + GID * sizeOfAQueue;
+    __global       uint       *nodes    = frontier + frontierOffsets[GID];
+
+    for (uint i = 0; i < openSizes[GID]; ++i)
+        nodes[i] = openList[i].first;
+}
+
+// ----- Path reconstruction --------------------------------------------------
+// Both run as a single work-item after the search. The predecessors form a chain from the
+// destination back to the source, which is its own predecessor. Only the path is downloaded.
+
+// length is 0 if the chain is longer than the graph, i.e. it has a cycle. The host checks that
+// rather than trusting the chain.
+__kernel void pathLength(__global const uint *predecessors,     // to recreate path
+                                  const ulong nodesSize,
+                                  const uint  destination,      // destination index
+                         __global       uint *length)           // nodes on the path
+{
+    if (get_global_id(0) != 0)
+        return;
+
+    uint count = 1;
+    for (uint node = destination; predecessors[node] != node; node = predecessors[node]) {
+        if (count == nodesSize) {
+            *length = 0;
+            return;
+        }
+        ++count;
+    }
+
+    *length = count;
+}
+
+__kernel void reconstructPath(__global const uint *predecessors, // to recreate path
+                                       const uint  destination,  // destination index
+                                       const uint  length,       // see pathLength
+                              __global       uint *path)         // node indices, source first
+{
+    if (get_global_id(0) != 0)
+        return;
+
+    uint node = destination;
+    for (uint i = length; i > 0; --i) {
+        path[i - 1] = node;
+        node = predecessors[node];
+    }
+}
@@ -5,10 +5,13 @@
 #include <boost/compute.hpp>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <iostream>
-#include <map>
+#include <iterator>
+#include <numeric>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 //#define DEBUG_LISTS
 
@@ -21,10 +24,16 @@ std::string bytes(unsigned long long bytes) {
         return std::to_string(bytes >> 10) + " KBytes";
     return std::to_string(bytes) + " bytes";
 }
+
+// OpenCL type of the per-node costs, see Graph::costData()
+std::string costType(int costBits) {
+    return costBits == 8 ? "uchar" : costBits == 16 ? "ushort" : "float";
+}
 } // namespace
 
 std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Position &destination,
-                            const boost::compute::device &clDevice) {
+                            const boost::compute::device &clDevice, GpuSearchStats *stats,
+                            float weight, int heapArity) {
     namespace compute = boost::compute;
 
     // Just so we don't have to handle this case in the kernels...
@@ -39,10 +48,6 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
     const std::size_t sizeOfAQueue =
         (std::size_t)(16 << (int) std::ceil(std::log2((double) graph.size() / numberOfQueues)));
     assert(sizeOfAQueue <= std::numeric_limits<compute::uint_>::max());
-    std::size_t targetHashTableSize = 1 << 10;         // Just a guess, TODO!
-    std::size_t hashTableSize = graph.width() / 3 - 1; // TODO: How to pick/calc this number?
-    while (hashTableSize < targetHashTableSize)
-        hashTableSize <<= 1;
 
 #ifdef GRAPH_DIAGONAL_MOVEMENT
     const std::size_t maxSuccessorsPerNode = 8;
@@ -69,16 +74,25 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
 
     // Set up OpenCL environment and build program
     compute::context       context(clDevice);
-    compute::command_queue queue(context, clDevice);
+    compute::command_queue queue(context, clDevice,
+                                 stats ? compute::command_queue::enable_profiling : 0);
+
+    // Only for heatmaps of this graph, see Heatmap.h
+    Heatmap *heatmap = stats ? stats->heatmap : nullptr;
+    if (heatmap && (heatmap->width() != graph.width() || heatmap->height() != graph.height()))
+        heatmap = nullptr;
 
     auto program = compute::program::create_with_source_file("src/gpuGAStar.cl", context);
-    program.build();
+    program.build("-DCOST_T=" + costType(graph.costBits()) +
+                  " -DHEURISTIC_WEIGHT=" + std::to_string(weight) + "f" +
+                  " -DHEAP_ARITY=" + std::to_string(heapArity) +
+                  (stats ? " -DSEARCH_COUNTERS" : "") + (heatmap ? " -DEXPANSION_HEATMAP" : ""));
 
     // Set up data structures on host
     // Let's use similar strucutures to the other GPU A* implementation.
     using uint_float = std::pair<compute::uint_, compute::float_>;
     std::vector<compute::int2_>  h_nodes;        // x, y
-    std::vector<uint_float>      h_edges;        // destination index, cost
+    std::vector<compute::uint_>  h_edges;        // destination index
     std::vector<compute::uint2_> h_adjacencyMap; // edges_begin, edges_end
 
     // Convert graph data
@@ -91,11 +105,10 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
             const Node current(graph, x, y);
             const auto begin = h_edges.size();
 
+            // Step costs are computed on the device from the per-node costs.
             for (const auto &neighbor : current.neighbors()) {
                 const auto &nbPosition = neighbor.first.position();
-                const float nbCost = neighbor.second;
-
-                h_edges.emplace_back(index(nbPosition.x, nbPosition.y), nbCost);
+                h_edges.push_back(index(nbPosition.x, nbPosition.y));
             }
 
             const auto end = h_edges.size();
@@ -107,49 +120,69 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
 
     // Device memory
     compute::vector<compute::int2_>  d_nodes(h_nodes.size(), context);
-    compute::vector<uint_float>      d_edges(h_edges.size(), context);
+    compute::vector<compute::uint_>  d_edges(h_edges.size(), context);
+    compute::buffer                  d_costs(context, graph.size() * graph.costBits() / 8);
     compute::vector<compute::uint2_> d_adjacencyMap(h_adjacencyMap.size(), context);
     compute::vector<uint_float>      d_openLists(numberOfQueues * sizeOfAQueue, context);
     compute::vector<compute::uint_>  d_openSizes(numberOfQueues, context);
 
     // std::tuple<...> has it's members in inverse order! :(
-    struct Info {
-        compute::uint_  closed; // only one of the first two members is used here
-        compute::uint_  node;   // the other one gives padding for memory alignment
+    struct Successor {
+        compute::uint_  node;
         compute::float_ totalCost;
         compute::uint_  predecessor;
     };
-    static_assert(sizeof(Info) == sizeof(compute::uint4_), "Type size check failed!");
+    static_assert(sizeof(Successor) == 3 * sizeof(compute::uint_), "Type size check failed!");
 
-    compute::vector<Info>           d_info(h_nodes.size(), context);
-    compute::vector<Info>           d_slistChunks(numberOfQueues * maxSuccessorsPerNode, context);
+    // Search state per node as structure of arrays: closed bits, total costs, predecessors.
+    compute::vector<compute::uint_>  d_closed((h_nodes.size() + 31) / 32, context);
+    compute::vector<compute::float_> d_totalCosts(h_nodes.size(), context);
+    compute::vector<compute::uint_>  d_predecessors(h_nodes.size(), context);
+
+    // Cheapest successor per node of the current round (float bits) and whether it was taken
+    compute::vector<compute::uint_> d_roundCosts(h_nodes.size(), context);
+    compute::vector<compute::uint_> d_roundClaims(h_nodes.size(), context);
+
+    compute::vector<Successor>      d_slistChunks(numberOfQueues * maxSuccessorsPerNode, context);
     compute::vector<compute::uint_> d_slistSizes(numberOfQueues, context);
-    compute::vector<Info>           d_tlistChunks(numberOfQueues * maxSuccessorsPerNode, context);
+    compute::vector<Successor>      d_tlistChunks(numberOfQueues * maxSuccessorsPerNode, context);
     compute::vector<compute::uint_> d_tlistSizes(numberOfQueues, context);
-    compute::vector<compute::uint_> d_hashTable(hashTableSize, context);
 
     compute::vector<compute::uint_> d_exclusiveSums(d_tlistSizes.size(), context);
-    compute::vector<Info>           d_tlistCompacted(d_tlistChunks.size(), context);
+    compute::vector<Successor>      d_tlistCompacted(d_tlistChunks.size(), context);
     compute::vector<compute::uint_> d_tlistCompactedSize(1, context);
     compute::vector<compute::uint_> d_queueRotation(1, context);
 
     compute::vector<compute::uint_> d_returnCode(1, context);
+    compute::vector<compute::uint_> d_bestCost(1, context); // float bits, see extractAndExpand
+
+    // Expanded nodes, pushes, pops, spills per queue
+    compute::vector<compute::uint4_> d_counters(stats ? numberOfQueues : 0, context);
+
+    // Expansions per node, and the nodes of all open lists after an iteration
+    compute::vector<compute::uint_> d_heatmap(heatmap ? h_nodes.size() : 0, context);
+    compute::vector<compute::uint_> d_frontierOffsets(heatmap ? numberOfQueues : 0, context);
+    compute::vector<compute::uint_> d_frontier(context);
 
 #ifdef DEBUG_OUTPUT
     std::cout << "Global memory used:"
               << "\n - Nodes: " << bytes(h_nodes.size() * sizeof(compute::int2_))
-              << "\n - Edges: " << bytes(h_edges.size() * sizeof(uint_float))
+              << "\n - Edges: " << bytes(h_edges.size() * sizeof(compute::uint_))
+              << "\n - Costs: " << bytes(d_costs.size())
               << "\n - Adjacency map: " << bytes(h_adjacencyMap.size() * sizeof(compute::uint2_))
               << "\n - Open lists: " << bytes(d_openLists.size() * sizeof(uint_float))
               << "\n - Open list sizes: " << bytes(d_openSizes.size() * sizeof(compute::uint_))
-              << "\n - Info table: " << bytes(d_info.size() * sizeof(Info))
-              << "\n - \"S\"-list chunks: " << bytes(d_slistChunks.size() * sizeof(Info))
+              << "\n - Closed list: " << bytes(d_closed.size() * sizeof(compute::uint_))
+              << "\n - Total costs: " << bytes(d_totalCosts.size() * sizeof(compute::float_))
+              << "\n - Predecessors: " << bytes(d_predecessors.size() * sizeof(compute::uint_))
+              << "\n - Round costs and claims: "
+              << bytes(2 * d_roundCosts.size() * sizeof(compute::uint_))
+              << "\n - \"S\"-list chunks: " << bytes(d_slistChunks.size() * sizeof(Successor))
               << "\n - \"S\"-list sizes: " << bytes(d_slistSizes.size() * sizeof(compute::uint_))
-              << "\n - \"T\"-list chunks: " << bytes(d_tlistChunks.size() * sizeof(Info))
+              << "\n - \"T\"-list chunks: " << bytes(d_tlistChunks.size() * sizeof(Successor))
               << "\n - \"T\"-list sizes: " << bytes(d_tlistSizes.size() * sizeof(compute::uint_))
-              << "\n - Hash table size: " << bytes(d_hashTable.size() * sizeof(compute::uint_))
               << "\n - Exclusive sums: " << bytes(d_exclusiveSums.size() * sizeof(compute::uint_))
-              << "\n - \"T\"-list compacted: " << bytes(d_tlistCompacted.size() * sizeof(Info))
+              << "\n - \"T\"-list compacted: " << bytes(d_tlistCompacted.size() * sizeof(Successor))
               << std::endl;
 #endif
 
@@ -157,6 +190,7 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
     compute::kernel clearSList(program, "clearList");
     compute::kernel extractAndExpand(program, "extractAndExpand");
     compute::kernel clearTList(program, "clearList");
+    compute::kernel cheapestSuccessors(program, "cheapestSuccessors");
     compute::kernel duplicateDetection(program, "duplicateDetection");
     compute::kernel compactTList(program, "compactTList");
     compute::kernel computeAndPushBack(program, "computeAndPushBack");
@@ -165,33 +199,48 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
     clearSList.set_arg(0, d_slistSizes);
     clearSList.set_arg<compute::ulong_>(1, d_slistSizes.size());
 
-    extractAndExpand.set_arg(0, d_edges);
-    extractAndExpand.set_arg<compute::ulong_>(1, d_edges.size());
-    extractAndExpand.set_arg(2, d_adjacencyMap);
-    extractAndExpand.set_arg<compute::ulong_>(3, d_adjacencyMap.size());
-    extractAndExpand.set_arg<compute::ulong_>(4, numberOfQueues);
-    extractAndExpand.set_arg<compute::ulong_>(5, sizeOfAQueue);
-    extractAndExpand.set_arg<compute::uint_>(6, index(destination.x, destination.y));
-    extractAndExpand.set_arg(7, d_openLists);
-    extractAndExpand.set_arg(8, d_openSizes);
-    extractAndExpand.set_arg(9, d_info);
-    extractAndExpand.set_arg(10, d_slistChunks);
-    extractAndExpand.set_arg(11, d_slistSizes);
-    extractAndExpand.set_arg<compute::ulong_>(12, maxSuccessorsPerNode);
-    extractAndExpand.set_arg(13, d_returnCode);
+    extractAndExpand.set_arg(0, d_nodes);
+    extractAndExpand.set_arg(1, d_edges);
+    extractAndExpand.set_arg<compute::ulong_>(2, d_edges.size());
+    extractAndExpand.set_arg(3, d_costs);
+    extractAndExpand.set_arg<compute::float_>(4, graph.costScale());
+    extractAndExpand.set_arg(5, d_adjacencyMap);
+    extractAndExpand.set_arg<compute::ulong_>(6, d_adjacencyMap.size());
+    extractAndExpand.set_arg<compute::ulong_>(7, numberOfQueues);
+    extractAndExpand.set_arg<compute::ulong_>(8, sizeOfAQueue);
+    extractAndExpand.set_arg<compute::uint_>(9, index(destination.x, destination.y));
+    extractAndExpand.set_arg(10, d_openLists);
+    extractAndExpand.set_arg(11, d_openSizes);
+    extractAndExpand.set_arg(12, d_totalCosts);
+    extractAndExpand.set_arg(13, d_slistChunks);
+    extractAndExpand.set_arg(14, d_slistSizes);
+    extractAndExpand.set_arg<compute::ulong_>(15, maxSuccessorsPerNode);
+    extractAndExpand.set_arg(16, d_returnCode);
+    extractAndExpand.set_arg(17, d_bestCost);
+    if (stats)
+        extractAndExpand.set_arg(18, d_counters);
+    if (heatmap)
+        extractAndExpand.set_arg(19, d_heatmap);
 
     clearTList.set_arg(0, d_tlistSizes);
     clearTList.set_arg<compute::ulong_>(1, d_tlistSizes.size());
 
+    cheapestSuccessors.set_arg<compute::ulong_>(0, numberOfQueues);
+    cheapestSuccessors.set_arg(1, d_closed);
+    cheapestSuccessors.set_arg(2, d_totalCosts);
+    cheapestSuccessors.set_arg(3, d_slistChunks);
+    cheapestSuccessors.set_arg(4, d_slistSizes);
+    cheapestSuccessors.set_arg<compute::ulong_>(5, maxSuccessorsPerNode);
+    cheapestSuccessors.set_arg(6, d_roundCosts);
+
     duplicateDetection.set_arg<compute::ulong_>(0, numberOfQueues);
-    duplicateDetection.set_arg(1, d_info);
-    duplicateDetection.set_arg(2, d_slistChunks);
-    duplicateDetection.set_arg(3, d_slistSizes);
-    duplicateDetection.set_arg<compute::ulong_>(4, maxSuccessorsPerNode);
-    duplicateDetection.set_arg(5, d_tlistChunks);
-    duplicateDetection.set_arg(6, d_tlistSizes);
-    duplicateDetection.set_arg(7, d_hashTable);
-    duplicateDetection.set_arg<compute::ulong_>(8, d_hashTable.size());
+    duplicateDetection.set_arg(1, d_roundCosts);
+    duplicateDetection.set_arg(2, d_roundClaims);
+    duplicateDetection.set_arg(3, d_slistChunks);
+    duplicateDetection.set_arg(4, d_slistSizes);
+    duplicateDetection.set_arg<compute::ulong_>(5, maxSuccessorsPerNode);
+    duplicateDetection.set_arg(6, d_tlistChunks);
+    duplicateDetection.set_arg(7, d_tlistSizes);
 
     compactTList.set_arg<compute::ulong_>(0, numberOfQueues);
     compactTList.set_arg(1, d_tlistChunks);
@@ -200,6 +249,8 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
     compactTList.set_arg(4, d_exclusiveSums);
     compactTList.set_arg(5, d_tlistCompacted);
     compactTList.set_arg(6, d_tlistCompactedSize);
+    compactTList.set_arg(7, d_roundCosts);
+    compactTList.set_arg(8, d_roundClaims);
 
     computeAndPushBack.set_arg(0, d_nodes);
     computeAndPushBack.set_arg<compute::ulong_>(1, d_nodes.size());
@@ -208,29 +259,49 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
     computeAndPushBack.set_arg<compute::uint_>(4, index(destination.x, destination.y));
     computeAndPushBack.set_arg(5, d_openLists);
     computeAndPushBack.set_arg(6, d_openSizes);
-    computeAndPushBack.set_arg(7, d_info);
-    computeAndPushBack.set_arg(8, d_tlistCompacted);
-    computeAndPushBack.set_arg(9, d_tlistCompactedSize);
-    computeAndPushBack.set_arg(10, d_queueRotation);
+    computeAndPushBack.set_arg(7, d_closed);
+    computeAndPushBack.set_arg(8, d_totalCosts);
+    computeAndPushBack.set_arg(9, d_predecessors);
+    computeAndPushBack.set_arg(10, d_tlistCompacted);
+    computeAndPushBack.set_arg(11, d_tlistCompactedSize);
+    computeAndPushBack.set_arg(12, d_queueRotation);
+    if (stats)
+        computeAndPushBack.set_arg(13, d_counters);
+
+    compute::kernel snapshotFrontier(program, "snapshotFrontier");
+    snapshotFrontier.set_arg<compute::ulong_>(0, numberOfQueues);
+    snapshotFrontier.set_arg<compute::ulong_>(1, sizeOfAQueue);
+    snapshotFrontier.set_arg(2, d_openLists);
+    snapshotFrontier.set_arg(3, d_openSizes);
+    snapshotFrontier.set_arg(4, d_frontierOffsets);
 
     // Data initialization
     std::vector<uint_float>     h_openLists(1, std::make_pair(index(source.x, source.y), 0.0f));
     std::vector<compute::uint_> h_openSizes(d_openSizes.size(), 0);
     h_openSizes.front() = 1; // only the first list contains one node: source
 
-    std::vector<Info> h_info(d_info.size(), {0, 0, 0.0f, 0});
-    const auto        sourceIndex = index(source.x, source.y);
-    h_info[sourceIndex].closed = 1;                // close source node
-    h_info[sourceIndex].predecessor = sourceIndex; // source is it's own predecessor
+    const compute::uint_        sourceIndex = index(source.x, source.y);
+    std::vector<compute::uint_> h_closed(d_closed.size(), 0);
+    h_closed[sourceIndex / 32] = 1u << (sourceIndex % 32); // close source node
 
     // Upload data
     const auto uploadStart = std::chrono::high_resolution_clock::now();
     compute::copy(h_nodes.begin(), h_nodes.end(), d_nodes.begin(), queue);
     compute::copy(h_edges.begin(), h_edges.end(), d_edges.begin(), queue);
+    queue.enqueue_write_buffer(d_costs, 0, d_costs.size(), graph.costData());
     compute::copy(h_adjacencyMap.begin(), h_adjacencyMap.end(), d_adjacencyMap.begin(), queue);
     compute::copy(h_openLists.begin(), h_openLists.end(), d_openLists.begin(), queue); // source
     compute::copy(h_openSizes.begin(), h_openSizes.end(), d_openSizes.begin(), queue);
-    compute::copy(h_info.begin(), h_info.end(), d_info.begin(), queue);
+    compute::copy(h_closed.begin(), h_closed.end(), d_closed.begin(), queue);
+    compute::fill(d_totalCosts.begin(), d_totalCosts.end(), 0.0f, queue);
+    compute::fill(d_roundCosts.begin(), d_roundCosts.end(), 0x7f800000u, queue); // infinity
+    compute::fill(d_roundClaims.begin(), d_roundClaims.end(), 0, queue);
+    compute::copy(&sourceIndex, std::next(&sourceIndex), // source is it's own predecessor
+                  std::next(d_predecessors.begin(), sourceIndex), queue);
+    compute::fill(d_bestCost.begin(), d_bestCost.end(), 0x7f800000u, queue); // infinity
+    if (stats)
+        compute::fill(d_counters.begin(), d_counters.end(), compute::uint4_(0, 0, 0, 0), queue);
+    compute::fill(d_heatmap.begin(), d_heatmap.end(), 0, queue);
     const auto uploadStop = std::chrono::high_resolution_clock::now();
 
     // TODO: Figure these out!
@@ -245,27 +316,25 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
 		<< "\nLocal work sizes: " << localWorkSize[0] << ", " << localWorkSize[1] << std::endl;
 #endif
 
-    std::map<std::string, std::chrono::duration<double>> kernelTimings;
+    // Kernel launches of the current iteration, for profiling
+    std::vector<std::pair<const char *, compute::event>> events;
 
-    // Run kernels
+    // Run kernels until no queue is left with a node cheaper than the best path to the destination
     compute::uint_ h_queueRotation = 0;
     compute::uint_ h_returnCode = 1; // still running
     while (h_returnCode == 1) {
-        int timeIndex = 0;
-
-        h_returnCode = 2; // no path found, as initial value
+        h_returnCode = 2; // all queues done, as initial value
         compute::copy(&h_returnCode, std::next(&h_returnCode), d_returnCode.begin(), queue);
         queue.enqueue_1d_range_kernel(clearSList, 0, globalWorkSize[0], localWorkSize[0]);
 
-        auto start = std::chrono::high_resolution_clock::now();
-        queue.enqueue_1d_range_kernel(extractAndExpand, 0, globalWorkSize[0], localWorkSize[0]);
-        queue.finish();
-        kernelTimings["ExtractAndExpand"] += std::chrono::high_resolution_clock::now() - start;
+        events.emplace_back("ExtractAndExpand",
+                            queue.enqueue_1d_range_kernel(extractAndExpand, 0, globalWorkSize[0],
+                                                          localWorkSize[0]));
 
         compute::copy(d_returnCode.begin(), d_returnCode.end(), &h_returnCode, queue);
 
 #ifdef DEBUG_LISTS
-        std::vector<Info>           h_slistChunks(d_slistChunks.size());
+        std::vector<Successor>      h_slistChunks(d_slistChunks.size());
         std::vector<compute::uint_> h_slistSizes(d_slistSizes.size());
         compute::copy(d_slistChunks.begin(), d_slistChunks.end(), h_slistChunks.begin(), queue);
         compute::copy(d_slistSizes.begin(), d_slistSizes.end(), h_slistSizes.begin(), queue);
@@ -285,14 +354,17 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
 
         queue.enqueue_1d_range_kernel(clearTList, 0, globalWorkSize[0], localWorkSize[0]);
 
-        start = std::chrono::high_resolution_clock::now();
-        queue.enqueue_nd_range_kernel(duplicateDetection, 2, 0, globalWorkSize.data(),
-                                      localWorkSize.data());
-        queue.finish();
-        kernelTimings["DuplicateDetection"] += std::chrono::high_resolution_clock::now() - start;
+        events.emplace_back("CheapestSuccessors",
+                            queue.enqueue_nd_range_kernel(cheapestSuccessors, 2, 0,
+                                                          globalWorkSize.data(),
+                                                          localWorkSize.data()));
+        events.emplace_back("DuplicateDetection",
+                            queue.enqueue_nd_range_kernel(duplicateDetection, 2, 0,
+                                                          globalWorkSize.data(),
+                                                          localWorkSize.data()));
 
 #ifdef DEBUG_LISTS
-        std::vector<Info>           h_tlistChunks(d_slistChunks.size());
+        std::vector<Successor>      h_tlistChunks(d_slistChunks.size());
         std::vector<compute::uint_> h_tlistSizes(d_slistSizes.size());
         compute::copy(d_tlistChunks.begin(), d_tlistChunks.end(), h_tlistChunks.begin(), queue);
         compute::copy(d_tlistSizes.begin(), d_tlistSizes.end(), h_tlistSizes.begin(), queue);
@@ -310,22 +382,17 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
 		std::cout << std::endl;
 #endif
 
-        start = std::chrono::high_resolution_clock::now();
+        // No event for this one, it may consist of several kernels.
         compute::exclusive_scan(d_tlistSizes.begin(), d_tlistSizes.end(), d_exclusiveSums.begin(),
                                 queue);
-        queue.finish();
-        kernelTimings["compute::exclusive_scan"] +=
-            std::chrono::high_resolution_clock::now() - start;
 
-        start = std::chrono::high_resolution_clock::now();
-        queue.enqueue_nd_range_kernel(compactTList, 2, 0, globalWorkSize.data(),
-                                      localWorkSize.data());
-        queue.finish();
-        kernelTimings["CompactTList"] += std::chrono::high_resolution_clock::now() - start;
+        events.emplace_back("CompactTList",
+                            queue.enqueue_nd_range_kernel(compactTList, 2, 0, globalWorkSize.data(),
+                                                          localWorkSize.data()));
 
 #ifdef DEBUG_LISTS
-        std::vector<Info> h_comp(d_tlistCompacted.size());
-        compute::uint_    h_compSize = 0;
+        std::vector<Successor> h_comp(d_tlistCompacted.size());
+        compute::uint_         h_compSize = 0;
         compute::copy(d_tlistCompacted.begin(), d_tlistCompacted.end(), h_comp.begin(), queue);
         compute::copy(d_tlistCompactedSize.begin(), d_tlistCompactedSize.end(), &h_compSize, queue);
         queue.finish();
@@ -338,10 +405,9 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
 		std::cout << "\n" << std::endl;
 #endif
 
-        start = std::chrono::high_resolution_clock::now();
-        queue.enqueue_1d_range_kernel(computeAndPushBack, 0, globalWorkSize[0], localWorkSize[0]);
-        queue.finish();
-        kernelTimings["ComputeAndPushBack"] += std::chrono::high_resolution_clock::now() - start;
+        events.emplace_back("ComputeAndPushBack",
+                            queue.enqueue_1d_range_kernel(computeAndPushBack, 0, globalWorkSize[0],
+                                                          localWorkSize[0]));
 
 #ifdef DEBUG_LISTS
         std::vector<uint_float>     h_openLists(d_openLists.size());
@@ -383,49 +449,105 @@ std::vector<Node> gpuGAStar(const Graph &graph, const Position &source, const Po
         }
 #endif
 
+        // Only the frontier is downloaded, compacted by the sizes known on the host already.
+        if (heatmap) {
+            std::vector<compute::uint_> h_frontierOffsets(numberOfQueues);
+            std::partial_sum(h_openSizes.begin(), std::prev(h_openSizes.end()),
+                             std::next(h_frontierOffsets.begin()));
+            const auto frontierSize = h_frontierOffsets.back() + h_openSizes.back();
+
+            std::vector<std::uint32_t> frontier(frontierSize);
+            if (frontierSize > 0) {
+                if (d_frontier.size() < frontierSize)
+                    d_frontier = compute::vector<compute::uint_>(frontierSize, context);
+                compute::copy(h_frontierOffsets.begin(), h_frontierOffsets.end(),
+                              d_frontierOffsets.begin(), queue);
+                snapshotFrontier.set_arg(5, d_frontier);
+                queue.enqueue_1d_range_kernel(snapshotFrontier, 0, globalWorkSize[0],
+                                              localWorkSize[0]);
+                compute::copy(d_frontier.begin(), std::next(d_frontier.begin(), frontierSize),
+                              frontier.begin(), queue);
+            }
+            heatmap->addFrontier(std::move(frontier));
+        }
+
         h_queueRotation = (h_queueRotation + 1) % numberOfQueues;
         compute::copy(&h_queueRotation, std::next(&h_queueRotation), d_queueRotation.begin(),
                       queue);
         queue.finish(); // make sure we have the returnCode downloaded
+
+        if (stats)
+            for (const auto &event : events)
+                stats->kernels.emplace_back(event.first, event.second);
+        events.clear();
     }
 
-    // Download data
+    // Reconstruct the path on the device, only the path itself is downloaded.
+    const compute::uint_        destIndex = index(destination.x, destination.y);
+    compute::float_             h_bestCost = 0.0f;
+    compute::uint_              h_pathLength = 0;
+    std::vector<compute::uint_> h_path; // node indices, source first
+
     const auto downloadStart = std::chrono::high_resolution_clock::now();
-    compute::copy(d_info.begin(), d_info.end(), h_info.begin(), queue);
+    queue.enqueue_read_buffer(d_bestCost.get_buffer(), 0, sizeof(h_bestCost), &h_bestCost);
+    if (std::isfinite(h_bestCost)) {
+        compute::vector<compute::uint_> d_pathLength(1, context);
+        compute::kernel                 pathLength(program, "pathLength");
+        pathLength.set_arg(0, d_predecessors);
+        pathLength.set_arg<compute::ulong_>(1, d_nodes.size());
+        pathLength.set_arg<compute::uint_>(2, destIndex);
+        pathLength.set_arg(3, d_pathLength);
+        const auto lengthEvent = queue.enqueue_1d_range_kernel(pathLength, 0, 1, 1);
+        compute::copy(d_pathLength.begin(), d_pathLength.end(), &h_pathLength, queue);
+        if (h_pathLength == 0)
+            throw std::runtime_error("Predecessors of the destination form a cycle!");
+
+        compute::vector<compute::uint_> d_path(h_pathLength, context);
+        compute::kernel                 reconstructPath(program, "reconstructPath");
+        reconstructPath.set_arg(0, d_predecessors);
+        reconstructPath.set_arg<compute::uint_>(1, destIndex);
+        reconstructPath.set_arg<compute::uint_>(2, h_pathLength);
+        reconstructPath.set_arg(3, d_path);
+        const auto reconstructEvent = queue.enqueue_1d_range_kernel(reconstructPath, 0, 1, 1);
+
+        h_path.resize(h_pathLength);
+        compute::copy(d_path.begin(), d_path.end(), h_path.begin(), queue);
+
+        if (stats) {
+            stats->kernels.emplace_back("PathLength", lengthEvent);
+            stats->kernels.emplace_back("ReconstructPath", reconstructEvent);
+        }
+    }
     const auto downloadStop = std::chrono::high_resolution_clock::now();
 
-    std::vector<Node> path;
-    if (h_returnCode == 0) {
-        // Recreate path
-        compute::uint_ nodeIndex = index(destination.x, destination.y);
-        compute::uint_ predecessor = h_info[nodeIndex].predecessor;
+    if (stats) {
+        stats->uploadTime += uploadStop - uploadStart;
+        stats->downloadTime += downloadStop - downloadStart;
+
+        std::vector<compute::uint4_> h_counters(d_counters.size());
+        compute::copy(d_counters.begin(), d_counters.end(), h_counters.begin(), queue);
+        for (const auto &counters : h_counters) {
+            stats->expanded += counters[0];
+            stats->pushes += counters[1];
+            stats->pops += counters[2];
+            stats->spills += counters[3];
+        }
+    }
 
-        while (nodeIndex != predecessor) {
-            const auto node = h_nodes[nodeIndex];
-            path.emplace_back(graph, node[0], node[1]);
+    if (heatmap) {
+        std::vector<compute::uint_> h_heatmap(d_heatmap.size());
+        compute::copy(d_heatmap.begin(), d_heatmap.end(), h_heatmap.begin(), queue);
+        heatmap->add(h_heatmap);
+    }
 
-            nodeIndex = predecessor;
-            predecessor = h_info[nodeIndex].predecessor;
-        }
+    std::vector<Node> path;
+    path.reserve(h_path.size());
+    for (const auto nodeIndex : h_path) {
         const auto node = h_nodes[nodeIndex];
         path.emplace_back(graph, node[0], node[1]);
-
-        // Path is in inverse order. Reverse it.
-        std::reverse(path.begin(), path.end());
-        assert(path.front().position() == source);
-        assert(path.back().position() == destination);
     }
-
-    // Print timings
-    std::cout << "GPU time for graph (" << graph.width() << ", " << graph.height() << "):"
-              << "\n - Upload time: "
-              << std::chrono::duration<double>(uploadStop - uploadStart).count() << " seconds"
-              << "\n - Kernel runtimes: ";
-    for (const auto &time : kernelTimings)
-        std::cout << "\n   - " << time.first << ": " << time.second.count() << " seconds";
-    std::cout << "\n - Download time: "
-              << std::chrono::duration<double>(downloadStop - downloadStart).count() << " seconds"
-              << std::endl;
+    assert(path.empty() || path.front().position() == source);
+    assert(path.empty() || path.back().position() == destination);
 
     return path;
 }
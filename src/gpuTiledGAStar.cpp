@@ -0,0 +1,133 @@
+#include "astar.h"
+
+#include "Connectivity.h"
+#include <algorithm>
+#include <boost/compute.hpp>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+// Upper estimate of the device memory gpuGAStar needs per node. The open lists dominate: up to
+// 32 entries of 8 bytes per node, depending on how the node count rounds to a power of two.
+const std::uint64_t bytesPerNode = 32 * 8;
+
+struct Window {
+    int x0, y0, x1, y1; // cells x0 <= x < x1, y0 <= y < y1
+
+    std::int64_t size() const { return (std::int64_t)(x1 - x0) * (y1 - y0); }
+};
+
+// Whole tiles around the bounding box of source and destination, margin tiles on every side
+Window window(const TiledGraph &graph, const Position &source, const Position &destination,
+              int margin) {
+    const auto tile = graph.tileSize();
+    const auto clamp = [](std::int64_t value, int max) {
+        return (int) std::max<std::int64_t>(0, std::min<std::int64_t>(value, max));
+    };
+
+    const std::int64_t tileX0 = std::min(source.x, destination.x) / tile - margin;
+    const std::int64_t tileY0 = std::min(source.y, destination.y) / tile - margin;
+    const std::int64_t tileX1 = std::max(source.x, destination.x) / tile + 1 + margin;
+    const std::int64_t tileY1 = std::max(source.y, destination.y) / tile + 1 + margin;
+
+    return {clamp(tileX0 * tile, graph.width()), clamp(tileY0 * tile, graph.height()),
+            clamp(tileX1 * tile, graph.width()), clamp(tileY1 * tile, graph.height())};
+}
+
+// Lower bound of any path that leaves the window, assuming costs of at least 1: such a path runs
+// through a cell just outside, so it costs at least the smallest h(source, c) + h(c, destination)
+// over the cells c surrounding the window.
+double leavingCost(const TiledGraph &graph, const Window &window, const Position &source,
+                   const Position &destination) {
+    double lowerBound = std::numeric_limits<double>::infinity();
+    auto   visit = [&](int x, int y) {
+        const Position cell = {x, y};
+        lowerBound = std::min<double>(lowerBound, GraphMoves::distance(source, cell) +
+                                                      GraphMoves::distance(cell, destination));
+    };
+
+    const int x0 = std::max(0, window.x0 - 1), x1 = std::min(graph.width(), window.x1 + 1);
+    const int y0 = std::max(0, window.y0 - 1), y1 = std::min(graph.height(), window.y1 + 1);
+    for (int x = x0; x < x1; ++x) {
+        if (window.y0 > 0)
+            visit(x, window.y0 - 1);
+        if (window.y1 < graph.height())
+            visit(x, window.y1);
+    }
+    for (int y = y0; y < y1; ++y) {
+        if (window.x0 > 0)
+            visit(window.x0 - 1, y);
+        if (window.x1 < graph.width())
+            visit(window.x1, y);
+    }
+
+    return lowerBound;
+}
+} // namespace
+
+std::vector<Position> gpuGAStar(TiledGraph &graph, const Position &source,
+                                const Position &destination,
+                                const boost::compute::device &clDevice, GpuSearchStats *stats) {
+    assert(graph.inBounds(source) && graph.inBounds(destination));
+
+    // Local indices on the device are 32 bit and every buffer has to fit into one allocation.
+    const auto maxNodes = (std::int64_t) std::min<std::uint64_t>(
+        std::min(clDevice.get_info<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+                 clDevice.global_memory_size() / 2) /
+            bytesPerNode,
+        std::numeric_limits<std::uint32_t>::max());
+
+    std::vector<Position> path;
+    int                   searched = -1; // margin of the last window searched
+    for (int margin = 1;; margin *= 2) {
+        auto current = window(graph, source, destination, margin);
+
+        // Too large: take the largest margin between the last one searched and this one that fits
+        const bool limited = current.size() > maxNodes;
+        if (limited) {
+            int fits = searched, tooLarge = margin;
+            while (tooLarge - fits > 1) {
+                const int middle = (fits + tooLarge) / 2;
+                if (window(graph, source, destination, middle).size() <= maxNodes)
+                    fits = middle;
+                else
+                    tooLarge = middle;
+            }
+
+            if (fits < 0)
+                throw std::length_error("Query does not fit into the memory of " +
+                                        clDevice.name());
+            if (fits == searched)
+                return path; // nothing larger fits than the last window
+
+            margin = fits;
+            current = window(graph, source, destination, margin);
+        }
+
+        const auto windowGraph = graph.window(current.x0, current.y0, current.x1 - current.x0,
+                                              current.y1 - current.y0);
+        const auto local = gpuGAStar(windowGraph, {source.x - current.x0, source.y - current.y0},
+                                     {destination.x - current.x0, destination.y - current.y0},
+                                     clDevice, stats);
+
+        path.clear();
+        double cost = std::numeric_limits<double>::infinity();
+        if (!local.empty()) {
+            cost = 0.0;
+            for (std::size_t i = 0; i < local.size(); ++i) {
+                const auto &p = local[i].position();
+                path.push_back({p.x + current.x0, p.y + current.y0});
+                if (i > 0)
+                    cost += windowGraph.pathCost(local[i - 1], local[i]);
+            }
+        }
+
+        searched = margin;
+        const bool wholeGraph = current.x0 == 0 && current.y0 == 0 &&
+                                current.x1 == graph.width() && current.y1 == graph.height();
+        if (wholeGraph || limited || cost <= leavingCost(graph, current, source, destination))
+            return path;
+    }
+}
@@ -1,12 +1,33 @@
+#include "ContractionHierarchy.h"
+#include "DStarLite.h"
+#include "Expansion.h"
 #include "Graph.h"
+#include "Heatmap.h"
+#include "PathDaemon.h"
+#include "PathDatabase.h"
+#include "PriorityQueue.h"
+#include "Scheduler.h"
 #include "astar.h"
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <csignal>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 namespace compute = boost::compute;
 
 // Little helper for validation
@@ -24,68 +45,173 @@ static float costs(const std::vector<Node> &path) {
     return costs;
 }
 
-// Run multi-agent A*
-static void runAStar(const compute::device &clDevice) {
+// Gold test: both paths missing, or found at the same cost
+static bool matchesGold(const std::vector<Node> &path, const std::vector<Node> &gold) {
+    return path.empty() == gold.empty() &&
+           std::abs(costs(path) - costs(gold)) <= 1e-3f * costs(gold);
+}
+
+// Random cell of the graph, blocked or not
+static Position randomPosition(const Graph &graph) {
+    static std::default_random_engine  generator(std::random_device{}());
+    std::uniform_int_distribution<int> distX(0, graph.width() - 1);
+    std::uniform_int_distribution<int> distY(0, graph.height() - 1);
+    return {distX(generator), distY(generator)};
+}
+
+// Queries between random cells
+static std::vector<std::pair<Position, Position>> randomQueries(const Graph &graph, int count) {
+    std::vector<std::pair<Position, Position>> srcDstList;
+    for (int i = 0; i < count; ++i)
+        srcDstList.emplace_back(randomPosition(graph), randomPosition(graph));
+    return srcDstList;
+}
+
+// Print timings and counters of an OpenCL search
+static void printStats(const GpuSearchStats &stats) {
+    // Sum up kernel launches by name
+    struct Times {
+        int    launches = 0;
+        double waiting = 0.0; // from queued to start
+        double running = 0.0; // from start to end
+    };
+    std::map<std::string, Times> kernels;
+    for (const auto &kernel : stats.kernels) {
+        auto &times = kernels[kernel.name];
+        ++times.launches;
+        times.waiting += (kernel.start - kernel.queued) * 1e-9;
+        times.running += (kernel.end - kernel.start) * 1e-9;
+    }
+
+    std::cout << " - Upload time: " << stats.uploadTime.count() << " seconds"
+              << "\n - Kernel runtimes:";
+    for (const auto &kernel : kernels)
+        std::cout << "\n   - " << kernel.first << ": " << kernel.second.running << " seconds ("
+                  << kernel.second.launches << " launches, " << kernel.second.waiting
+                  << " seconds queued)";
+    double kernelTime = 0.0;
+    for (const auto &kernel : kernels)
+        kernelTime += kernel.second.running;
+
+    std::cout << "\n - Download time: " << stats.downloadTime.count() << " seconds"
+              << "\n - Expanded nodes: " << stats.expanded << "\n - Open list pushes: "
+              << stats.pushes << ", pops: " << stats.pops << ", spills: " << stats.spills;
+    if (stats.agents)
+        std::cout << "\n - Agents: " << stats.agents;
+    if (kernelTime > 0.0)
+        std::cout << " (" << (stats.pushes + stats.pops) / kernelTime / 1e6
+                  << " million pushes and pops per second of kernel time)";
+    std::cout << std::endl;
+}
+
+// Print counters and timings of CPU searches
+static void printStats(const CpuSearchStats &stats) {
+    std::cout << " - Search time: " << stats.searchTime.count() << " seconds"
+              << "\n - Path reconstruction time: " << stats.reconstructTime.count() << " seconds"
+              << "\n - Expanded nodes: " << stats.expansions
+              << "\n - Relaxed edges: " << stats.relaxations
+              << "\n - Largest open list: " << stats.openHighWater << std::endl;
+}
+
+// Run multi-agent A*, on costs quantized to costBits (8 or 16) unless 32
+static void runAStar(const std::vector<compute::device> &clDevices, int costBits = 32) {
     // Generate graph and obstacles
     Graph graph(50, 50); // should be small
     graph.generateObstacles();
+    if (costBits != 32) {
+        std::cout << " ----- Costs quantized to " << costBits << " bits" << std::endl;
+        graph.quantizeCosts(costBits); // 1 or 2 bytes per node instead of 4
+    }
 
     // Generate source/destination pairs
-    const int                          pathCount = 2500; // should be big
-    std::random_device                 rd;
-    std::default_random_engine         generator(rd());
-    std::uniform_int_distribution<int> distX(0, graph.width() - 1);
-    std::uniform_int_distribution<int> distY(0, graph.height() - 1);
+    const int pathCount = 2500; // should be big
+    auto      srcDstList = randomQueries(graph, pathCount);
 
-    std::vector<std::pair<Position, Position>> srcDstList;
-    for (int i = 0; i < pathCount; ++i)
-        srcDstList.emplace_back(Position{distX(generator), distY(generator)},
-                                Position{distX(generator), distY(generator)});
+    // Some repeated and reversed queries, which gpuAStar searches only once
+    for (int i = 0; i < pathCount / 10; ++i) {
+        const auto &srcDst = srcDstList[i * 7];
+        srcDstList[pathCount - 1 - i] =
+            i % 2 ? srcDst : std::make_pair(srcDst.second, srcDst.first);
+    }
 
     // CPU reference run
-    std::vector<std::vector<Node>> cpuPaths;
-    cpuPaths.reserve(srcDstList.size());
-
     std::cout << " ----- CPU reference run..." << std::endl;
-    const auto cpuStart = std::chrono::high_resolution_clock::now();
-    for (const auto &srcDst : srcDstList)
-        cpuPaths.emplace_back(cpuAStar(graph, srcDst.first, srcDst.second));
-    const auto cpuStop = std::chrono::high_resolution_clock::now();
+    CpuSearchStats cpuStats;
+    const auto     cpuStart = std::chrono::high_resolution_clock::now();
+    const auto     cpuPaths = cpuAStar(graph, srcDstList, &cpuStats);
+    const auto     cpuStop = std::chrono::high_resolution_clock::now();
 
     // Print cpu timing
     std::cout << "CPU time for " << pathCount
               << " runs: " << std::chrono::duration<double>(cpuStop - cpuStart).count()
               << " seconds" << std::endl;
+    printStats(cpuStats);
 
     // Print graph (with first path) to image
-    graph.toPfm("AStarCPU.pfm", cpuPaths.front());
+    graph.toPfm("AStarCPU.pfm", cpuPaths[0].nodes(graph));
 
     try {
+#if 1
+        // Pick local memory per agent and work-group size for this map on every device first
+        std::cout << " ----- GPU A* calibration..." << std::endl;
+        for (const auto &clDevice : clDevices) {
+#if 0
+            // Compare the heap arities of the kernel, the binary heap is calibrated last and kept
+            for (const int heapArity : {8, 4})
+                std::cout << clDevice.name() << ", " << heapArity << "-ary heaps: "
+                          << calibrateGpuAStar(graph, srcDstList, clDevice, heapArity)
+                                 .agentsPerSecond
+                          << " agents per second" << std::endl;
+#endif
+            const auto launch = calibrateGpuAStar(graph, srcDstList, clDevice);
+            std::cout << clDevice.name() << ": " << launch.localBytesPerAgent
+                      << " bytes of local memory per agent, " << launch.workGroupSize
+                      << " agents per work-group (" << launch.spills << " spills, "
+                      << launch.agentsPerSecond << " agents per second)" << std::endl;
+        }
+#endif
+
         // GPU A* run
         std::cout << " ----- GPU A* run..." << std::endl;
-        const auto gpuPaths = gpuAStar(graph, srcDstList, clDevice);
+        GpuSearchStats stats;
+        PathCache      cache;
+        const auto     gpuPaths = gpuAStar(graph, srcDstList, clDevices, &stats, 1.0f, &cache);
+
+        std::cout << "GPU time for " << pathCount << " runs:" << std::endl;
+        printStats(stats);
+
+        // The same batch again, answered from the cache
+        GpuSearchStats cachedStats;
+        const auto     cachedPaths =
+            gpuAStar(graph, srcDstList, clDevices, &cachedStats, 1.0f, &cache);
+        if (cachedPaths.cells() != gpuPaths.cells())
+            std::cerr << "Cached run: paths differ from the first run!" << std::endl;
+        std::cout << "Cached run: " << cachedStats.agents << " agents, " << cache.hits()
+                  << " cache hits, " << cache.misses() << " misses" << std::endl;
 
         assert(cpuPaths.size() == gpuPaths.size());
 
         for (std::size_t i = 0; i < cpuPaths.size(); ++i) {
-            const auto &cpuPath = cpuPaths[i];
-            const auto &gpuPath = gpuPaths[i];
+            const auto cpuPath = cpuPaths[i];
+            const auto gpuPath = gpuPaths[i];
 
-            if (std::equal(cpuPath.begin(), cpuPath.end(), gpuPath.begin(), gpuPath.end())) {
+            if (cpuPaths.status(i) == gpuPaths.status(i) &&
+                std::equal(cpuPath.begin(), cpuPath.end(), gpuPath.begin(), gpuPath.end())) {
                 // std::cout << "GPU A* " << i << ": Gold test passed! (exact match)" << std::endl;
-            } else if (cpuPath.size() == gpuPath.size() &&
-                       std::abs(costs(cpuPath) - costs(gpuPath)) < 0.1f) {
+            } else if (cpuPaths.status(i) == gpuPaths.status(i) &&
+                       std::abs(costs(cpuPath.nodes(graph)) - costs(gpuPath.nodes(graph))) < 0.1f) {
                 // std::cout << "GPU A* " << i << ": Gold test passed! (equal match)" << std::endl;
             } else {
                 std::cerr << "GPU A* " << i << ": Gold test failed!"
                           << "\n - Path length CPU: " << cpuPath.size()
-                          << ", GPU: " << gpuPath.size() << "\n - Path cost CPU: " << costs(cpuPath)
-                          << ", GPU: " << costs(gpuPath) << std::endl;
+                          << ", GPU: " << gpuPath.size()
+                          << "\n - Path cost CPU: " << costs(cpuPath.nodes(graph))
+                          << ", GPU: " << costs(gpuPath.nodes(graph)) << std::endl;
             }
         }
 
         // Print graph (with first path) to image
-        graph.toPfm("AStarGPU.pfm", gpuPaths.front());
+        graph.toPfm("AStarGPU.pfm", gpuPaths[0].nodes(graph));
     } catch (std::exception &e) {
         std::cerr << "A* execution failed:\n" << e.what() << std::endl;
     }
@@ -96,20 +222,52 @@ static void runGAStar(const compute::device &clDevice) {
     // Generate graph and obstacles
     Graph graph(500, 500); // should be big
     graph.generateObstacles();
+#if 0
+    graph.quantizeCosts(16); // 2 bytes per node instead of 4
+#endif
 
     const Position source{10, 20};
     const Position destination{graph.width() - 10, graph.height() - 20};
 
     // CPU reference run
     std::cout << " ----- CPU reference run..." << std::endl;
-    const auto cpuStart = std::chrono::high_resolution_clock::now();
-    const auto cpuPath = cpuAStar(graph, source, destination);
-    const auto cpuStop = std::chrono::high_resolution_clock::now();
+    CpuSearchStats cpuStats;
+    const auto     cpuStart = std::chrono::high_resolution_clock::now();
+    const auto     cpuPath = cpuAStar(graph, source, destination, &cpuStats);
+    const auto     cpuStop = std::chrono::high_resolution_clock::now();
 
     // Print cpu timing
     std::cout << "CPU time for graph (" << graph.width() << ", " << graph.height()
               << "): " << std::chrono::duration<double>(cpuStop - cpuStart).count() << " seconds"
               << std::endl;
+    printStats(cpuStats);
+
+    // Bounded suboptimal CPU runs: weighted A* and anytime A* within the time of the optimal run
+    const auto weighted = cpuWeightedAStar(graph, source, destination, 2.0f);
+    std::cout << "CPU weighted A* (weight 2): cost " << costs(weighted.path) << ", bound "
+              << weighted.bound << " (optimal: " << costs(cpuPath) << ")" << std::endl;
+
+    cpuAnytimeAStar(graph, source, destination,
+                    std::chrono::steady_clock::now() + (cpuStop - cpuStart),
+                    [&](const BoundedPath &path) {
+                        std::cout << "CPU anytime A*: cost " << costs(path.path) << ", bound "
+                                  << path.bound << std::endl;
+                    });
+
+    // The same parallel algorithm as on the GPU, on CPU threads, with where it spent its work
+    Heatmap        threadHeat(graph.width(), graph.height());
+    CpuSearchStats threadStats;
+    threadStats.heatmap = &threadHeat;
+    const auto threadPath = cpuGAStar(graph, source, destination, 0, &threadStats);
+    std::cout << "CPU GA* on " << std::thread::hardware_concurrency() << " threads: cost "
+              << costs(threadPath) << " (optimal: " << costs(cpuPath) << ")" << std::endl;
+    printStats(threadStats);
+#if 1
+    threadHeat.toPfm("GAStarCPUHeat.pfm", graph);
+    if (!threadHeat.frontiers().empty())
+        threadHeat.frontierToPfm("GAStarCPUFrontier.pfm", graph,
+                                 threadHeat.frontiers().size() / 2);
+#endif
 
     // Print graph (with first path) to image
     graph.toPfm("GAStarCPU.pfm", cpuPath);
@@ -117,7 +275,14 @@ static void runGAStar(const compute::device &clDevice) {
     try {
         // GPU GA* run
         std::cout << " ----- GPU GA* run..." << std::endl;
-        const auto gpuPath = gpuGAStar(graph, source, destination, clDevice);
+        Heatmap        heat(graph.width(), graph.height());
+        GpuSearchStats stats;
+        stats.heatmap = &heat;
+        const auto gpuPath = gpuGAStar(graph, source, destination, clDevice, &stats);
+
+        std::cout << "GPU time for graph (" << graph.width() << ", " << graph.height()
+                  << "):" << std::endl;
+        printStats(stats);
 
         if (std::equal(cpuPath.begin(), cpuPath.end(), gpuPath.begin(), gpuPath.end())) {
             // std::cout << "GPU GA* " << i << ": Gold test passed! (exact match)" << std::endl;
@@ -133,12 +298,634 @@ static void runGAStar(const compute::device &clDevice) {
 
         // Print graph (with first path) to image
         graph.toPfm("GAStarGPU.pfm", gpuPath);
+#if 1
+        heat.toPfm("GAStarGPUHeat.pfm", graph);
+        heat.save("GAStarGPU.heat");
+#endif
     } catch (std::exception &e) {
         std::cerr << "GA* execution failed:\n" << e.what() << std::endl;
     }
 }
 
-int main() {
+// Cost of a path on a tiled graph
+static float costs(TiledGraph &graph, const std::vector<Position> &path) {
+    float costs = 0.0f;
+    for (std::size_t i = 1; i < path.size(); ++i)
+        costs += graph.pathCost(path[i - 1], path[i]);
+    return costs;
+}
+
+// Search across tiles that are loaded on demand
+static void runTiledAStar(const compute::device &clDevice) {
+    // Gold test against the untiled graph, with few resident tiles to force evictions
+    Graph graph(500, 500);
+    graph.generateObstacles();
+    TiledGraph tiled(graph.width(), graph.height(), TiledGraph::graphLoader(graph), 64, 8);
+
+    const Position source{10, 20};
+    const Position destination{graph.width() - 10, graph.height() - 20};
+    const auto     cpuPath = cpuAStar(graph, source, destination);
+
+    const auto tiledPath = cpuAStar(tiled, source, destination);
+    std::cout << "CPU tiled A*: cost " << costs(tiled, tiledPath) << " (untiled: " << costs(cpuPath)
+              << "), " << tiled.loads() << " tile loads, " << tiled.evictions() << " evictions"
+              << std::endl;
+
+    try {
+        const auto gpuPath = gpuGAStar(tiled, source, destination, clDevice);
+        std::cout << "GPU tiled GA*: cost " << costs(tiled, gpuPath) << std::endl;
+    } catch (std::exception &e) {
+        std::cerr << "Tiled GA* execution failed:\n" << e.what() << std::endl;
+    }
+
+    // A million by a million cells, generated tile by tile
+    TiledGraph huge(1 << 20, 1 << 20, [](int x, int y, int width, int height, float *costs) {
+        for (int row = y; row < y + height; ++row) {
+            for (int column = x; column < x + width; ++column) {
+                const auto hash = (unsigned) column * 73856093u ^ (unsigned) row * 19349663u;
+                *costs++ = (hash >> 7) % 100 < 8 ? 6.0f : 1.0f;
+            }
+        }
+    });
+
+    CpuSearchStats stats;
+    const auto     hugePath = cpuAStar(huge, {500000, 500000}, {501000, 500500}, &stats);
+    std::cout << "CPU tiled A* on (" << huge.width() << ", " << huge.height() << "): cost "
+              << costs(huge, hugePath) << ", " << huge.residentTiles() << " resident tiles"
+              << std::endl;
+    printStats(stats);
+}
+
+// Let an agent walk to its goal while obstacles appear ahead of it, replanning incrementally
+static void runDStarLite() {
+    Graph graph(300, 300);
+    graph.generateObstacles();
+
+    const Position destination{graph.width() - 10, graph.height() - 20};
+    DStarLite      agent(graph, {10, 20}, destination);
+
+    std::random_device         rd;
+    std::default_random_engine generator(rd());
+
+    CpuSearchStats incremental, scratch;
+    int            mismatches = 0;
+    for (auto path = agent.path(&incremental); path.size() > 1; path = agent.path(&incremental)) {
+        agent.move(path[1].position());
+
+        // Every few steps a small obstacle shows up somewhere on the path ahead
+        if (generator() % 4 != 0 || path.size() < 4)
+            continue;
+
+        const auto       center = path[2 + generator() % (path.size() - 3)].position();
+        std::vector<int> changed;
+        for (int y = center.y - 2; y <= center.y + 2; ++y) {
+            for (int x = center.x - 2; x <= center.x + 2; ++x) {
+                const Node node(graph, x, y);
+                if (!node.inBounds() || node.position() == destination)
+                    continue;
+                graph.setCost(y * graph.width() + x, graph.cost(y * graph.width() + x) + 10.0f);
+                changed.push_back(y * graph.width() + x);
+            }
+        }
+        agent.costsChanged(changed);
+
+        // Gold test against a search from scratch
+        const auto replanned = agent.path(&incremental);
+        const auto gold = cpuAStar(graph, agent.position(), destination, &scratch);
+        if (!matchesGold(replanned, gold))
+            ++mismatches;
+    }
+
+    std::cout << "D* Lite: " << mismatches << " gold test failures"
+              << "\n - Incremental: " << incremental.expansions << " expansions, "
+              << (incremental.searchTime + incremental.reconstructTime).count() << " seconds"
+              << "\n - From scratch: " << scratch.expansions << " expansions, "
+              << (scratch.searchTime + scratch.reconstructTime).count() << " seconds" << std::endl;
+}
+
+// Let the scheduler route queries and calibrate itself
+static void runScheduler() {
+    Graph graph(200, 200);
+    graph.generateObstacles();
+
+    Scheduler scheduler(graph);
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int round = 0; round < 20; ++round) {
+        // A small batch, a large batch and a single long query
+        for (const auto batchSize : {16, 1000})
+            scheduler.findPaths(randomQueries(graph, batchSize));
+
+        scheduler.findPath({0, 0}, {graph.width() - 1, graph.height() - 1});
+    }
+    const auto stop = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Scheduler time: " << std::chrono::duration<double>(stop - start).count()
+              << " seconds"
+              << "\n - CPU queries: " << scheduler.queries(Scheduler::Cpu)
+              << "\n - GA* queries: " << scheduler.queries(Scheduler::GAStar)
+              << "\n - Multi-agent A* queries: " << scheduler.queries(Scheduler::Batch)
+              << std::endl;
+}
+
+// Build a compressed path database once, then answer queries by table lookups
+static void runPathDatabase() {
+    Graph graph(60, 60);
+    graph.generateObstacles();
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    PathDatabase(graph).save("AStar.cpd");
+    const auto built = std::chrono::high_resolution_clock::now();
+    const PathDatabase database(graph, "AStar.cpd");
+
+    const auto srcDstList = randomQueries(graph, 2500);
+
+    const auto queried = std::chrono::high_resolution_clock::now();
+    std::vector<std::vector<Node>> paths;
+    for (const auto &srcDst : srcDstList)
+        paths.push_back(database.path(srcDst.first, srcDst.second));
+    const auto stop = std::chrono::high_resolution_clock::now();
+
+    // Gold test against cpuAStar
+    CpuSearchStats stats;
+    int            mismatches = 0;
+    for (std::size_t i = 0; i < srcDstList.size(); ++i) {
+        const auto gold = cpuAStar(graph, srcDstList[i].first, srcDstList[i].second, &stats);
+        if (!matchesGold(paths[i], gold))
+            ++mismatches;
+    }
+
+    std::cout << "Path database: " << mismatches << " gold test failures"
+              << "\n - Build time: " << std::chrono::duration<double>(built - start).count()
+              << " seconds"
+              << "\n - Size: " << database.runs() << " runs, " << database.bytes() / 1024 << " KiB"
+              << "\n - Query time: " << std::chrono::duration<double>(stop - queried).count()
+              << " seconds, cpuAStar: "
+              << (stats.searchTime + stats.reconstructTime).count() << " seconds" << std::endl;
+}
+
+// Contract a static map once, then answer queries in the hierarchy
+static void runContractionHierarchy() {
+    Graph graph(100, 100);
+    graph.generateObstacles();
+
+    const auto                 start = std::chrono::high_resolution_clock::now();
+    const ContractionHierarchy hierarchy(graph);
+    const auto                 built = std::chrono::high_resolution_clock::now();
+
+    const auto srcDstList = randomQueries(graph, 1000);
+
+    CpuSearchStats                 queryStats;
+    std::vector<std::vector<Node>> paths;
+    for (const auto &srcDst : srcDstList)
+        paths.push_back(hierarchy.path(srcDst.first, srcDst.second, &queryStats));
+
+    // Gold test against cpuAStar
+    CpuSearchStats stats;
+    int            mismatches = 0;
+    for (std::size_t i = 0; i < srcDstList.size(); ++i) {
+        const auto gold = cpuAStar(graph, srcDstList[i].first, srcDstList[i].second, &stats);
+        if (!matchesGold(paths[i], gold))
+            ++mismatches;
+    }
+
+    std::cout << "Contraction hierarchy: " << mismatches << " gold test failures"
+              << "\n - Build time: " << std::chrono::duration<double>(built - start).count()
+              << " seconds, " << hierarchy.shortcuts() << " shortcuts, " << hierarchy.arcs()
+              << " arcs"
+              << "\n - Queries: " << queryStats.expansions << " expansions, "
+              << (queryStats.searchTime + queryStats.reconstructTime).count() << " seconds"
+              << "\n - cpuAStar: " << stats.expansions << " expansions, "
+              << (stats.searchTime + stats.reconstructTime).count() << " seconds" << std::endl;
+}
+
+// Wall off half of the map and let the component index reject queries across the wall
+// Costs of quantized graphs must stay apart from the level of blocked cells
+static void runQuantization() {
+    int failures = 0;
+    for (const int bits : {8, 16}) {
+        // A maximum cost of the highest finite level makes the scale 1.
+        const float topLevel = (float) ((1 << bits) - 2);
+        Graph       graph(4, 4);
+        graph.setCost(1, topLevel);
+        graph.quantizeCosts(bits);
+
+        graph.setCost(0, topLevel); // still finite
+        bool rejected = false;
+        try {
+            graph.setCost(0, topLevel + 0.5f); // rounds up to the level of blocked cells
+        } catch (const std::out_of_range &) {
+            rejected = true;
+        }
+        if (!rejected || graph.cost(0) != topLevel || graph.cost(1) != topLevel)
+            ++failures;
+    }
+    std::cout << "Quantization: " << failures << " failures of the highest level" << std::endl;
+}
+
+static void runComponents() {
+    Graph graph(300, 300);
+    graph.generateObstacles();
+
+    // A wall down the middle, with a door that is opened and closed again below
+    const int wall = graph.width() / 2, door = (graph.height() / 2) * graph.width() + wall;
+    for (int y = 0; y < graph.height(); ++y)
+        graph.setCost(y * graph.width() + wall, std::numeric_limits<float>::infinity());
+
+    // The same map without an index, for the gold test
+    std::vector<float> cellCosts(graph.size());
+    for (int i = 0; i < graph.size(); ++i)
+        cellCosts[i] = graph.cost(i);
+    const Graph unindexed(graph.width(), graph.height(), cellCosts);
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    graph.indexComponents();
+    const auto indexed = std::chrono::high_resolution_clock::now();
+
+    auto passable = [&]() {
+        Position p;
+        do
+            p = randomPosition(graph);
+        while (graph.blocked(p.y * graph.width() + p.x));
+        return p;
+    };
+
+    std::vector<std::pair<Position, Position>> srcDstList;
+    for (int i = 0; i < 100; ++i)
+        srcDstList.emplace_back(passable(), passable());
+
+    CpuSearchStats withIndex, without;
+    const auto     paths = cpuAStar(graph, srcDstList, &withIndex);
+    const auto     gold = cpuAStar(unindexed, srcDstList, &without);
+
+    int mismatches = 0;
+    for (std::size_t i = 0; i < srcDstList.size(); ++i)
+        if (paths.status(i) != gold.status(i) ||
+            !matchesGold(paths[i].nodes(graph), gold[i].nodes(unindexed)))
+            ++mismatches;
+
+    // Opening the door merges both halves, closing it splits them again.
+    const int left = 0, right = graph.width() - 1;
+    graph.setCost(door, 1.0f);
+    const bool merged = graph.component(left) == graph.component(right);
+    graph.setCost(door, std::numeric_limits<float>::infinity());
+    const bool split = graph.component(left) != graph.component(right);
+
+    std::cout << "Components: " << mismatches << " gold test failures"
+              << "\n - Index time: " << std::chrono::duration<double>(indexed - start).count()
+              << " seconds"
+              << "\n - Door: " << (merged && split ? "merges and splits" : "FAILED")
+              << "\n - With index: " << withIndex.expansions << " expansions, "
+              << (withIndex.searchTime + withIndex.reconstructTime).count() << " seconds"
+              << "\n - Without: " << without.expansions << " expansions, "
+              << (without.searchTime + without.reconstructTime).count() << " seconds"
+              << std::endl;
+}
+
+// Send units to the nearest of a few or many resource cells
+static void runNearest(const compute::device &clDevice) {
+    Graph graph(200, 200);
+    graph.generateObstacles();
+
+    for (const int goalCount : {4, 32}) {
+        std::vector<Position> resources;
+        for (int i = 0; i < goalCount; ++i)
+            resources.push_back(randomPosition(graph));
+
+        std::vector<GoalQuery> queries;
+        for (int i = 0; i < 100; ++i)
+            queries.emplace_back(randomPosition(graph), resources);
+
+        CpuSearchStats stats;
+        const auto     paths = cpuNearestAStar(graph, queries, &stats);
+
+        // Gold test: the cheapest of one cpuAStar run per goal
+        CpuSearchStats goldStats;
+        int            mismatches = 0;
+        for (std::size_t i = 0; i < queries.size(); ++i) {
+            float gold = std::numeric_limits<float>::infinity();
+            for (const auto &goal : resources) {
+                const auto path = cpuAStar(graph, queries[i].first, goal, &goldStats);
+                if (!path.empty())
+                    gold = std::min(gold, costs(path));
+            }
+
+            const auto path = paths[i].nodes(graph);
+            if (path.empty() ? gold != std::numeric_limits<float>::infinity()
+                             : std::abs(costs(path) - gold) > 1e-3f * gold)
+                ++mismatches;
+        }
+
+        std::cout << "Nearest of " << goalCount << " goals: " << mismatches
+                  << " gold test failures"
+                  << "\n - cpuNearestAStar: " << stats.expansions << " expansions, "
+                  << (stats.searchTime + stats.reconstructTime).count() << " seconds"
+                  << "\n - cpuAStar per goal: " << goldStats.expansions << " expansions, "
+                  << (goldStats.searchTime + goldStats.reconstructTime).count() << " seconds"
+                  << std::endl;
+
+        try {
+            GpuSearchStats gpuStats;
+            const auto     gpuPaths = gpuNearestAStar(graph, queries, clDevice, &gpuStats);
+
+            int gpuMismatches = 0;
+            for (std::size_t i = 0; i < queries.size(); ++i)
+                if (gpuPaths.status(i) != paths.status(i) ||
+                    !matchesGold(gpuPaths[i].nodes(graph), paths[i].nodes(graph)))
+                    ++gpuMismatches;
+
+            std::cout << " - gpuNearestAStar: " << gpuMismatches << " gold test failures, "
+                      << gpuStats.expanded << " expansions" << std::endl;
+        } catch (std::exception &e) {
+            std::cerr << "Nearest goal GPU A* execution failed:\n" << e.what() << std::endl;
+        }
+    }
+}
+
+// Daemon mode, see PathDaemon.h:
+//   ocl-astar --daemon [--socket PATH] [--map FILE WIDTH HEIGHT | --random WIDTH HEIGHT]
+//                      [--window MICROSECONDS] [--batch SIZE]
+// The map file holds WIDTH * HEIGHT floats, row by row. Stops on SIGINT or SIGTERM.
+#ifndef _WIN32
+// One query to a running daemon as its client, false if it is not answered within 5 seconds
+static bool queryDaemon(const std::string &socketPath, const Graph &graph) {
+    const int   fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    const timeval timeout = {5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // The daemon may not be listening yet.
+    bool connected = false;
+    for (int attempt = 0; attempt < 500 && !connected; ++attempt) {
+        connected =
+            ::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+        if (!connected)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    auto readAll = [&](void *data, std::size_t size) {
+        return ::recv(fd, data, size, MSG_WAITALL) == (ssize_t) size;
+    };
+
+    auto query = [&]() {
+        PathDaemon::Hello hello;
+        if (!connected || !readAll(&hello, sizeof(hello)) || hello.magic != PathDaemon::magic)
+            return false;
+
+        const PathDaemon::Request request = {42, 0, 0, graph.width() - 1, graph.height() - 1};
+        PathDaemon::Response      response;
+        if (::send(fd, &request, sizeof(request), 0) != (ssize_t) sizeof(request) ||
+            !readAll(&response, sizeof(response)) || response.id != request.id ||
+            response.status == PathDaemon::Invalid)
+            return false;
+
+        std::vector<std::uint32_t> cells(response.length);
+        return readAll(cells.data(), cells.size() * sizeof(cells[0]));
+    };
+    const bool answered = query();
+    ::close(fd);
+    return answered;
+}
+
+// Serve a query, stop, and serve one again on the same daemon
+static void runPathDaemon() {
+    Graph graph(100, 100);
+    graph.generateObstacles();
+
+    Scheduler           scheduler(graph);
+    PathDaemon::Options options;
+    options.socketPath = "/tmp/ocl-astar-test.sock";
+    PathDaemon daemon(graph, scheduler, options);
+
+    int answered = 0;
+    for (int run = 0; run < 2; ++run) {
+        std::thread server([&] { daemon.run(); });
+        answered += queryDaemon(options.socketPath, graph);
+        daemon.stop();
+        server.join();
+    }
+
+    std::cout << "Path daemon: " << answered << " of 2 runs answered" << std::endl;
+}
+#endif
+
+static PathDaemon *runningDaemon = nullptr;
+
+static int runDaemon(int argc, char **argv) {
+    PathDaemon::Options options;
+    std::string         mapFile;
+    int                 width = 1000, height = 1000;
+
+    for (int i = 2; i < argc; ++i) {
+        const std::string option = argv[i];
+        auto              values = [&](int count) {
+            if (i + count >= argc)
+                throw std::invalid_argument(option + " needs " + std::to_string(count) +
+                                            " values");
+            i += count;
+            return argv + i - count + 1;
+        };
+
+        if (option == "--socket")
+            options.socketPath = values(1)[0];
+        else if (option == "--window")
+            options.batchWindow = std::chrono::microseconds(std::stoll(values(1)[0]));
+        else if (option == "--batch")
+            options.maxBatchSize = std::max(1ull, std::stoull(values(1)[0]));
+        else if (option == "--map") {
+            const auto arguments = values(3);
+            mapFile = arguments[0];
+            width = std::stoi(arguments[1]);
+            height = std::stoi(arguments[2]);
+        } else if (option == "--random") {
+            const auto arguments = values(2);
+            mapFile.clear();
+            width = std::stoi(arguments[0]);
+            height = std::stoi(arguments[1]);
+        } else
+            throw std::invalid_argument("Unknown option " + option);
+    }
+
+    // Load the map once, through a tiled graph reading the whole file as one window
+    Graph graph(width, height);
+    if (mapFile.empty())
+        graph.generateObstacles();
+    else
+        graph = TiledGraph(width, height, TiledGraph::rawFileLoader(mapFile, width))
+                    .window(0, 0, width, height);
+
+    Scheduler  scheduler(graph);
+    PathDaemon daemon(graph, scheduler, options);
+
+    runningDaemon = &daemon;
+    for (const auto signal : {SIGINT, SIGTERM})
+        std::signal(signal, [](int) { runningDaemon->stop(); });
+
+    std::cout << "Serving paths on " << width << "x" << height << " map at "
+              << options.socketPath << std::endl;
+    daemon.run();
+    runningDaemon = nullptr;
+
+    std::cout << "Answered " << daemon.queries() << " queries in " << daemon.batches()
+              << " batches" << std::endl;
+    return 0;
+}
+
+// Expansions per second of the scalar and vectorized neighbor expansion
+static void benchmarkExpansion() {
+    Graph graph(1000, 1000);
+    graph.generateObstacles();
+    const auto *costs = static_cast<const float *>(graph.costData());
+
+    struct Variant {
+        const char *   name;
+        ExpandFunction expand;
+        bool           supported;
+    };
+    const Variant variants[] = {{"Scalar", expandScalar, true},
+                                {"SSE", expandSse, hasSse()},
+                                {"AVX2", expandAvx2, hasAvx2()}};
+
+    std::cout << "Expansion benchmark:";
+    for (const auto &variant : variants) {
+        if (!variant.supported)
+            continue;
+
+        // Interior cells only, the vectorized versions leave the border to the scalar one
+        Expansion  expansion;
+        float      checksum = 0.0f; // keeps the compiler from dropping the work
+        const int  rounds = 20;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            for (int y = 1; y < graph.height() - 1; ++y) {
+                for (int x = 1; x < graph.width() - 1; ++x) {
+                    variant.expand(costs, graph.width(), graph.height(), x, y, 0.0f, 500, 500,
+                                   expansion);
+                    checksum += expansion.totalCosts[x % 8] + expansion.heuristics[y % 8];
+                }
+            }
+        }
+        const auto stop = std::chrono::high_resolution_clock::now();
+
+        const auto seconds = std::chrono::duration<double>(stop - start).count();
+        std::cout << "\n - " << variant.name << ": "
+                  << (double) rounds * (graph.width() - 2) * (graph.height() - 2) / seconds / 1e6
+                  << " million expansions per second (checksum " << checksum << ")";
+    }
+    std::cout << std::endl;
+}
+
+static void benchmarkOpenLists() {
+    Graph graph(2000, 2000);
+    graph.generateObstacles();
+
+    std::mt19937                               random(7);
+    std::uniform_int_distribution<int>         coordinate(0, 1999);
+    std::vector<std::pair<Position, Position>> srcDstList;
+    for (int i = 0; i < 10; ++i)
+        srcDstList.push_back(
+            {{coordinate(random), coordinate(random)}, {coordinate(random), coordinate(random)}});
+
+    struct Variant {
+        const char *name;
+        OpenList    openList;
+    };
+    const Variant variants[] = {{"Binary heap", OpenList::BinaryHeap},
+                                {"4-ary heap", OpenList::FourAryHeap},
+                                {"8-ary heap", OpenList::EightAryHeap},
+                                {"Radix heap", OpenList::RadixHeap}};
+
+    std::cout << "Open list benchmark, " << srcDstList.size() << " paths on "
+              << graph.width() << "x" << graph.height() << ":";
+    for (const auto &variant : variants) {
+        CpuSearchStats stats;
+        const auto     start = std::chrono::high_resolution_clock::now();
+        const auto     paths = cpuAStar(graph, srcDstList, nullptr, variant.openList);
+        const auto     stop = std::chrono::high_resolution_clock::now();
+        cpuAStar(graph, srcDstList, &stats, variant.openList); // counted apart, not timed
+
+        const auto seconds = std::chrono::duration<double>(stop - start).count();
+        std::cout << "\n - " << variant.name << ": " << seconds * 1000 << " ms, "
+                  << stats.expansions / seconds / 1e6 << " million expansions per second";
+    }
+    std::cout << std::endl;
+}
+
+// Pushes and pops per second of PriorityQueue, in the pattern of A*: every popped node queues a
+// few successors that are a bit more expensive, so the heap grows with the search.
+template <std::size_t Arity>
+static double heapOperationsPerSecond() {
+    struct Entry {
+        std::uint32_t node;
+        float         priority;
+    };
+    struct Compare {
+        bool operator()(const Entry &a, const Entry &b) { return a.priority > b.priority; }
+    };
+
+    const std::uint32_t pops = 1 << 22;
+    std::mt19937        random(3);
+    std::vector<float>  steps(1024);
+    for (auto &step : steps)
+        step = std::uniform_real_distribution<float>(1.0f, 2.0f)(random);
+
+    PriorityQueue<Entry, Compare, Arity> open;
+    std::uint64_t                        operations = 0;
+    float                                checksum = 0.0f;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    open.push({0, 0.0f});
+    for (std::uint32_t i = 0; i < pops && !open.empty(); ++i) {
+        const auto current = open.top();
+        open.pop();
+        checksum += current.priority;
+
+        const auto successors = 1 + i % 2; // half a node more per pop
+        for (std::uint32_t j = 0; j < successors; ++j)
+            open.push({i, current.priority + steps[(i + j) % steps.size()]});
+        operations += 1 + successors;
+    }
+    const auto stop = std::chrono::high_resolution_clock::now();
+
+    if (checksum < 0.0f) // keeps the compiler from dropping the work
+        std::cout << checksum;
+    return operations / std::chrono::duration<double>(stop - start).count();
+}
+
+static void benchmarkHeaps() {
+    std::cout << "Heap benchmark, million pushes and pops per second:"
+              << "\n - Binary heap: " << heapOperationsPerSecond<2>() / 1e6
+              << "\n - 4-ary heap: " << heapOperationsPerSecond<4>() / 1e6
+              << "\n - 8-ary heap: " << heapOperationsPerSecond<8>() / 1e6 << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--daemon") {
+        try {
+            return runDaemon(argc, argv);
+        } catch (std::exception &e) {
+            std::cerr << "Daemon failed:\n" << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+#if 1
+    // Compare the expansion kernels of cpuAStar
+    benchmarkExpansion();
+#endif
+
+#if 1
+    // Compare the heap arities of the open lists
+    benchmarkHeaps();
+#endif
+
+#if 1
+    // Compare the open lists of cpuAStar on a large map
+    benchmarkOpenLists();
+#endif
+
 #if 1
     // Select default OpenCL device
     compute::device dev = compute::system::default_device();
@@ -153,12 +940,54 @@ int main() {
 #endif
 	std::cout << "OpenCL device: " << dev.name() << std::endl;
 
+#if 1
+    // Split the multi-agent batch over all OpenCL devices
+    const auto devices = compute::system::devices();
+    for (const auto &d : devices)
+        std::cout << "OpenCL device for A*: " << d.name() << std::endl;
+#else
+    const std::vector<compute::device> devices = {dev};
+#endif
+
     // Run multi-agent A*
-    runAStar(dev);
+    runAStar(devices);
+#if 1
+    // Again on quantized costs, which CPU and GPU must search exactly alike
+    runAStar(devices, 8);
+#endif
 
     // Run parallel GA*
     runGAStar(dev);
 
+    // Run A* on tiles
+    runTiledAStar(dev);
+
+    // Replan incrementally on a changing map
+    runDStarLite();
+
+    // Run mixed queries through the scheduler
+    runScheduler();
+
+#ifndef _WIN32
+    // Serve queries over a socket, twice on the same daemon
+    runPathDaemon();
+#endif
+
+    // Answer queries from precomputed first moves
+    runPathDatabase();
+
+    // Answer queries in a contraction hierarchy
+    runContractionHierarchy();
+
+    // Keep quantized costs apart from blocked cells
+    runQuantization();
+
+    // Reject queries between walled off parts of the map
+    runComponents();
+
+    // Find the nearest of several goals in one search
+    runNearest(dev);
+
 #ifdef _WIN32
     std::cout << "\nPress ENTER to continue..." << std::flush;
     std::cin.ignore();